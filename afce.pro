@@ -129,16 +129,35 @@ SOURCES += main.cpp \
     zvflowchart_layout.cpp \
     zvflowchart_paint.cpp \
     qflowchartstyle.cpp \
-    sourcecodegenerator.cpp
+    sourcecodegenerator.cpp \
+    benchmark.cpp \
+    tracer.cpp \
+    documentloader.cpp \
+    documentsaver.cpp \
+    generatorindex.cpp \
+    generateall.cpp \
+    journal.cpp
 
 HEADERS += mainwindow.h \
     thelpwindow.h \
     zvflowchart.h \
     qflowchartstyle.h \
-    sourcecodegenerator.h
+    sourcecodegenerator.h \
+    benchmark.h \
+    tracer.h \
+    documentloader.h \
+    documentsaver.h \
+    generatorindex.h \
+    generateall.h \
+    journal.h
 
 RESOURCES += afce.qrc
 CONFIG += release
+
+# "make check" builds and runs the tests in tests/
+check.commands = $$sprintf($$QMAKE_MKDIR_CMD, tests) && \
+    cd tests && $(QMAKE) $$shell_quote($$PWD/tests/tests.pro) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += check
 TRANSLATIONS += locale/afce_en_US.ts \
     locale/afce_ru_RU.ts \
     locale/afce_uk_UA.ts
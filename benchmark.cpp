@@ -0,0 +1,356 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#include "benchmark.h"
+#include "mainwindow.h"
+#include "sourcecodegenerator.h"
+#include "zvflowchart.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMap>
+#include <QPainter>
+#include <QTextStream>
+#include <QXmlStreamWriter>
+
+namespace {
+
+const int maxPaintExtent = 4096;
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QString digest(const QByteArray &data)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex().left(16));
+}
+
+/* returns the best time of the given number of runs in milliseconds */
+template<typename Function>
+double measure(int iterations, Function function)
+{
+    double best = -1;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        function();
+        double ms = timer.nsecsElapsed() / 1000000.0;
+        if (best < 0 || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+int countBlocks(const QBlock *block)
+{
+    int result = 1;
+    for (int i = 0; i < block->items.size(); ++i)
+        result += countBlocks(block->item(i));
+    return result;
+}
+
+void appendGeometry(const QBlock *block, QByteArray &data)
+{
+    data += QString("%1 %2 %3 %4 %5\n").arg(block->type())
+            .arg(block->x, 0, 'f', 2).arg(block->y, 0, 'f', 2)
+            .arg(block->width, 0, 'f', 2).arg(block->height, 0, 'f', 2).toUtf8();
+    for (int i = 0; i < block->items.size(); ++i)
+        appendGeometry(block->item(i), data);
+}
+
+void writeSyntheticBranch(QXmlStreamWriter &xml, int &remaining, int depth, int maxItems)
+{
+    xml.writeStartElement("branch");
+    for (int count = 0; remaining > 0 && count < maxItems; ++count) {
+        --remaining;
+        bool nest = depth < 6;
+        switch (remaining % 7) {
+        case 0:
+            xml.writeStartElement("process");
+            xml.writeAttribute("text", QString("func%1()").arg(remaining));
+            xml.writeEndElement();
+            break;
+        case 1:
+            xml.writeStartElement("assign");
+            xml.writeAttribute("dest", "x");
+            xml.writeAttribute("src", QString("x + %1").arg(remaining));
+            xml.writeEndElement();
+            break;
+        case 2:
+            xml.writeStartElement(remaining % 2 ? "io" : "ou");
+            xml.writeAttribute("vars", "a,b,c");
+            xml.writeEndElement();
+            break;
+        case 3:
+            xml.writeStartElement("if");
+            xml.writeAttribute("cond", QString("x > %1").arg(remaining));
+            writeSyntheticBranch(xml, remaining, depth + 1, nest ? 4 : 0);
+            writeSyntheticBranch(xml, remaining, depth + 1, nest ? 3 : 0);
+            xml.writeEndElement();
+            break;
+        case 4:
+            xml.writeStartElement("for");
+            xml.writeAttribute("var", "i");
+            xml.writeAttribute("from", "0");
+            xml.writeAttribute("to", "n - 1");
+            writeSyntheticBranch(xml, remaining, depth + 1, nest ? 4 : 0);
+            xml.writeEndElement();
+            break;
+        default:
+            xml.writeStartElement(remaining % 2 ? "pre" : "post");
+            xml.writeAttribute("cond", "x < n");
+            writeSyntheticBranch(xml, remaining, depth + 1, nest ? 4 : 0);
+            xml.writeEndElement();
+            break;
+        }
+    }
+    xml.writeEndElement();
+}
+
+/* generates a chart with the given number of blocks of every kind */
+QString syntheticChart(int blocks)
+{
+    QString result;
+    QXmlStreamWriter xml(&result);
+    xml.writeStartElement("algorithm");
+    int remaining = blocks;
+    writeSyntheticBranch(xml, remaining, 0, blocks);
+    xml.writeEndElement();
+    return result;
+}
+
+/* generates a chart of the given number of loops nested in each other,
+   the worst case for the indentation of the generated code */
+QString syntheticNestedChart(int depth)
+{
+    QString result;
+    QXmlStreamWriter xml(&result);
+    xml.writeStartElement("algorithm");
+    xml.writeStartElement("branch");
+    for (int i = 0; i < depth; ++i) {
+        xml.writeStartElement(i % 2 ? "pre" : "for");
+        if (i % 2) {
+            xml.writeAttribute("cond", QString("x%1 < n").arg(i));
+        }
+        else {
+            xml.writeAttribute("var", QString("i%1").arg(i));
+            xml.writeAttribute("from", "0");
+            xml.writeAttribute("to", "n - 1");
+        }
+        xml.writeStartElement("branch");
+    }
+    xml.writeStartElement("process");
+    xml.writeAttribute("text", "func()");
+    xml.writeEndElement();
+    for (int i = 0; i < depth; ++i) {
+        xml.writeEndElement();
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+    xml.writeEndElement();
+    return result;
+}
+
+bool readChart(const QString &fileName, QString &contents)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    contents = QString::fromUtf8(file.readAll());
+    return true;
+}
+
+void benchmarkChart(const QString &name, const QString &contents, int iterations,
+                    QMap<QString, QString> &digests)
+{
+    QFlowChart chart;
+    chart.setStatus(QFlowChart::Display);
+
+    double loadTime = measure(1, [&]() { chart.fromString(contents); });
+    QBlock *r = chart.root();
+
+    double layoutTime = measure(iterations, [&]() { chart.realignObjects(); });
+    QByteArray geometry;
+    appendGeometry(r, geometry);
+    digests.insert(name + "/layout", digest(geometry));
+
+    QImage img(qBound(1, int(r->width), maxPaintExtent), qBound(1, int(r->height), maxPaintExtent),
+               QImage::Format_ARGB32_Premultiplied);
+    double paintTime = measure(iterations, [&]() {
+        img.fill(0);
+        QPainter canvas(&img);
+        canvas.setRenderHint(QPainter::Antialiasing);
+        chart.paintTo(&canvas);
+    });
+
+    QString xml;
+    double saveTime = measure(iterations, [&]() { xml = chart.toString(); });
+    digests.insert(name + "/xml", digest(xml.toUtf8()));
+
+    out() << name << "\n";
+    out() << "  blocks:   " << countBlocks(r) << "\n";
+    out() << "  size:     " << r->width << " x " << r->height << "\n";
+    out() << "  layout:   " << digests.value(name + "/layout") << "\n";
+    out() << "  memory:   " << chart.memoryUsage().toString().replace("\n", "\n            ") << "\n";
+    out() << QString("  load      %1 ms\n").arg(loadTime, 0, 'f', 3);
+    out() << QString("  realign   %1 ms\n").arg(layoutTime, 0, 'f', 3);
+    out() << QString("  paint     %1 ms\n").arg(paintTime, 0, 'f', 3);
+    out() << QString("  toString  %1 ms\n").arg(saveTime, 0, 'f', 3);
+
+    QDir gd("generators:");
+    QStringList gens = gd.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
+    SourceCodeNode algorithm;
+    double treeTime = measure(iterations, [&]() { algorithm = SourceCodeNode::fromDocument(chart.document()); });
+    out() << QString("  codetree  %1 ms\n").arg(treeTime, 0, 'f', 3);
+    QStringList rules;
+    for (int g = 0; g < gens.size(); ++g) {
+        QString id = QFileInfo(gens[g]).baseName();
+        rules << gd.absoluteFilePath(gens[g]);
+        SourceCodeGenerator gen;
+        gen.loadRule(rules.last());
+        QString code;
+        double genTime = measure(iterations, [&]() { code = gen.applyRule(algorithm); });
+        QString key = name + "/code/" + id;
+        digests.insert(key, digest(code.toUtf8()));
+        out() << QString("  codegen %1 %2 ms  %3\n").arg(id, -10).arg(genTime, 0, 'f', 3).arg(digests.value(key));
+    }
+    double allTime = measure(iterations, [&]() { SourceCodeGenerator::generateAll(algorithm, rules); });
+    out() << QString("  codegen all (parallel) %1 ms\n").arg(allTime, 0, 'f', 3);
+    out().flush();
+}
+
+QMap<QString, QString> readBaseline(const QString &fileName)
+{
+    QMap<QString, QString> result;
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream stream(&file);
+        while (!stream.atEnd()) {
+            QStringList fields = stream.readLine().split('\t');
+            if (fields.size() == 2)
+                result.insert(fields[0], fields[1]);
+        }
+    }
+    return result;
+}
+
+bool writeBaseline(const QString &fileName, const QMap<QString, QString> &digests)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+        return false;
+    QTextStream stream(&file);
+    for (QMap<QString, QString>::const_iterator it = digests.constBegin(); it != digests.constEnd(); ++it)
+        stream << it.key() << '\t' << it.value() << '\n';
+    return true;
+}
+
+}
+
+int runBenchmark(const QStringList &arguments)
+{
+    int iterations = 10;
+    QList<int> synthetic;
+    QList<int> nested;
+    QString baseline, newBaseline;
+    QStringList files;
+
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString &arg = arguments.at(i);
+        bool hasValue = i + 1 < arguments.size();
+        if (arg == "--bench")
+            continue;
+        else if (arg == "--iterations" && hasValue)
+            iterations = qMax(1, arguments.at(++i).toInt());
+        else if (arg == "--synthetic" && hasValue)
+            synthetic << arguments.at(++i).toInt();
+        else if (arg == "--synthetic-depth" && hasValue)
+            nested << arguments.at(++i).toInt();
+        else if (arg == "--baseline" && hasValue)
+            baseline = arguments.at(++i);
+        else if (arg == "--write-baseline" && hasValue)
+            newBaseline = arguments.at(++i);
+        else if (arg == "--trace" && hasValue)
+            ++i;
+        else if (!arg.startsWith("-"))
+            files << arg;
+    }
+
+    if (files.isEmpty() && synthetic.isEmpty() && nested.isEmpty()) {
+        out() << "Usage: afce --bench [--iterations N] [--synthetic BLOCKS] [--synthetic-depth LOOPS]\n"
+                 "                    [--baseline FILE] [--write-baseline FILE] [chart.afc ...]\n";
+        out().flush();
+        return 2;
+    }
+
+    setupDataSearchPaths();
+
+    QMap<QString, QString> digests;
+    for (int i = 0; i < files.size(); ++i) {
+        QString contents;
+        if (!readChart(files[i], contents)) {
+            out() << "Unable to read " << files[i] << "\n";
+            out().flush();
+            return 2;
+        }
+        benchmarkChart(QFileInfo(files[i]).fileName(), contents, iterations, digests);
+    }
+    for (int i = 0; i < synthetic.size(); ++i) {
+        benchmarkChart(QString("synthetic-%1").arg(synthetic[i]), syntheticChart(synthetic[i]), iterations, digests);
+    }
+    for (int i = 0; i < nested.size(); ++i) {
+        benchmarkChart(QString("synthetic-depth-%1").arg(nested[i]), syntheticNestedChart(nested[i]), iterations, digests);
+    }
+
+    if (!newBaseline.isEmpty() && !writeBaseline(newBaseline, digests)) {
+        out() << "Unable to write " << newBaseline << "\n";
+        out().flush();
+        return 2;
+    }
+
+    int mismatches = 0;
+    if (!baseline.isEmpty()) {
+        QMap<QString, QString> expected = readBaseline(baseline);
+        /* a chart or a generator that is missing or new counts too,
+           otherwise dropping one would pass silently */
+        for (QMap<QString, QString>::const_iterator it = expected.constBegin(); it != expected.constEnd(); ++it) {
+            if (!digests.contains(it.key())) {
+                out() << "MISSING " << it.key() << ": expected " << it.value() << "\n";
+                ++mismatches;
+            }
+            else if (digests.value(it.key()) != it.value()) {
+                out() << "MISMATCH " << it.key() << ": expected " << it.value()
+                      << ", got " << digests.value(it.key()) << "\n";
+                ++mismatches;
+            }
+        }
+        for (QMap<QString, QString>::const_iterator it = digests.constBegin(); it != digests.constEnd(); ++it) {
+            if (!expected.contains(it.key())) {
+                out() << "NEW " << it.key() << ": got " << it.value() << "\n";
+                ++mismatches;
+            }
+        }
+        out() << (mismatches ? "FAIL" : "PASS") << ": " << mismatches << " mismatch(es) against " << baseline << "\n";
+        out().flush();
+    }
+    return mismatches ? 1 : 0;
+}
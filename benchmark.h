@@ -0,0 +1,28 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QStringList>
+
+/* Headless benchmark and regression mode (afce --bench ...).
+   Loads each chart, times layout, painting, serialization and code
+   generation, and prints digests of the layout and the generated code.
+   The digests can be written to a baseline file and checked against it
+   later, so that optimizations can not silently change the results. */
+int runBenchmark(const QStringList &arguments);
+
+#endif // BENCHMARK_H
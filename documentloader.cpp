@@ -0,0 +1,93 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#include "documentloader.h"
+#include "tracer.h"
+#include "zvflowchart.h"
+
+#include <QDomDocument>
+#include <QFile>
+#include <QThread>
+
+namespace {
+const qint64 readChunkSize = 64 * 1024;
+
+/* blocks created on the pool thread are handed over to the thread that
+   will own the document */
+void moveTree(QBlock *block, QThread *thread)
+{
+    block->moveToThread(thread);
+    for (int i = 0; i < block->items.size(); ++i)
+        moveTree(block->item(i), thread);
+}
+}
+
+AfcDocumentLoader::AfcDocumentLoader(const QString &aFileName)
+    : fFileName(aFileName), fCanceled(0), fRoot(0)
+{
+    setAutoDelete(false);
+}
+
+AfcDocumentLoader::~AfcDocumentLoader()
+{
+    delete fRoot;
+}
+
+QBlock *AfcDocumentLoader::takeRoot()
+{
+    QBlock *result = fRoot;
+    fRoot = 0;
+    return result;
+}
+
+void AfcDocumentLoader::cancel()
+{
+    fCanceled.storeRelease(1);
+}
+
+void AfcDocumentLoader::run()
+{
+    AFC_TRACE("AfcDocumentLoader::run");
+    QFile file(fFileName);
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        /* reading 0..20%, parsing 20..50%, building 50..80%, layout 80..100% */
+        QByteArray data;
+        qint64 size = qMax(file.size(), qint64(1));
+        while (!file.atEnd() && !isCanceled()) {
+            data += file.read(readChunkSize);
+            emit progress(int(qMin(data.size(), size) * 20 / size));
+        }
+        file.close();
+
+        QDomDocument doc;
+        if (!isCanceled() && doc.setContent(data, false)) {
+            data.clear();
+            emit progress(50);
+            QBlock *root = new QBlock();
+            root->setXmlNode(doc.firstChildElement());
+            doc.clear();
+            emit progress(80);
+            if (!isCanceled()) {
+                root->makeBackwardCompatibility();
+                root->adjustSize(1);
+                root->adjustPosition(0, 0);
+                emit progress(100);
+            }
+            moveTree(root, thread());
+            fRoot = root;
+        }
+    }
+    emit finished();
+}
@@ -0,0 +1,55 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef DOCUMENTLOADER_H
+#define DOCUMENTLOADER_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+
+class QBlock;
+
+/* Reads, parses and lays out a chart on a thread pool thread. The result
+   is a detached block tree laid out at zoom 1 that belongs to the thread
+   which created the loader; it is handed to QFlowChart::setRoot() there.
+   The loader is not deleted automatically: use deleteLater() in response to
+   finished(), or delete it after waiting for its thread pool. */
+class AfcDocumentLoader : public QObject, public QRunnable
+{
+    Q_OBJECT
+  private:
+    QString fFileName;
+    QAtomicInt fCanceled;
+    QBlock *fRoot;
+
+  public:
+    explicit AfcDocumentLoader(const QString &aFileName);
+    ~AfcDocumentLoader();
+    QString fileName() const { return fFileName; }
+    bool isCanceled() const { return fCanceled.loadAcquire() != 0; }
+    QBlock *takeRoot(); // 0 when the file could not be read or parsed
+    void run() override;
+
+  public slots:
+    void cancel(); // may be called from any thread
+
+  signals:
+    void progress(int percent);
+    void finished();
+};
+
+#endif // DOCUMENTLOADER_H
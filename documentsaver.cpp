@@ -0,0 +1,52 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+
+#include "documentsaver.h"
+#include "tracer.h"
+#include "zvflowchart.h"
+
+#include <QDomDocument>
+#include <QSaveFile>
+
+AfcDocumentSaver::AfcDocumentSaver(const QString &aFileName, QBlock *aSnapshot, int aRevision, QObject *parent)
+    : QObject(parent), fFileName(aFileName), fSnapshot(aSnapshot), fRevision(aRevision), fSucceeded(false)
+{
+    setAutoDelete(false);
+}
+
+AfcDocumentSaver::~AfcDocumentSaver()
+{
+    delete fSnapshot;
+}
+
+void AfcDocumentSaver::run()
+{
+    AFC_TRACE("AfcDocumentSaver::run");
+    QDomDocument doc("AFC");
+    doc.appendChild(fSnapshot->xmlNode(doc));
+    QByteArray data = doc.toString(2).toUtf8();
+    doc.clear();
+
+    /* the old file stays untouched until the new one is written completely */
+    QSaveFile file(fFileName);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text) && file.write(data) == data.size())
+        fSucceeded = file.commit();
+    else
+        file.cancelWriting();
+    if (!fSucceeded)
+        fErrorString = file.errorString();
+    emit finished();
+}
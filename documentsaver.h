@@ -0,0 +1,53 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef DOCUMENTSAVER_H
+#define DOCUMENTSAVER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+
+class QBlock;
+
+/* Writes a snapshot of a chart on a thread pool thread. The snapshot is
+   a detached copy of the block tree, so the document can be edited while
+   it is saved. The file is written through QSaveFile and replaced only
+   when it is complete. The saver is not deleted automatically, delete it
+   after finished(). */
+class AfcDocumentSaver : public QObject, public QRunnable
+{
+    Q_OBJECT
+  private:
+    QString fFileName;
+    QBlock *fSnapshot;
+    int fRevision;
+    bool fSucceeded;
+    QString fErrorString;
+
+  public:
+    AfcDocumentSaver(const QString &aFileName, QBlock *aSnapshot, int aRevision, QObject *parent = 0); // takes ownership of aSnapshot
+    ~AfcDocumentSaver();
+    QString fileName() const { return fFileName; }
+    int revision() const { return fRevision; } // of the document when the snapshot was taken
+    bool isSucceeded() const { return fSucceeded; }
+    QString errorString() const { return fErrorString; }
+    void run() override;
+
+  signals:
+    void finished();
+};
+
+#endif // DOCUMENTSAVER_H
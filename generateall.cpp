@@ -0,0 +1,119 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+
+#include "generateall.h"
+#include "mainwindow.h"
+#include "sourcecodegenerator.h"
+#include "tracer.h"
+#include "zvflowchart.h"
+
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QTextStream>
+
+namespace {
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+bool loadAlgorithm(const QString &fileName, SourceCodeNode &algorithm)
+{
+    QFile file(fileName);
+    QDomDocument doc;
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text) || !doc.setContent(&file, false))
+        return false;
+    /* the same document the editor would generate code from */
+    QBlock root;
+    root.setXmlNode(doc.firstChildElement());
+    root.makeBackwardCompatibility();
+    QDomDocument normalized("AFC");
+    normalized.appendChild(root.xmlNode(normalized));
+    algorithm = SourceCodeNode::fromDocument(normalized);
+    return true;
+}
+
+}
+
+int runGenerateAll(const QStringList &arguments)
+{
+    int index = arguments.indexOf("--generate-all");
+    if (index < 0 || index + 2 >= arguments.size()) {
+        out() << "Usage: afce --generate-all chart.afc outdir\n";
+        out().flush();
+        return 2;
+    }
+    QString fileName = arguments.at(index + 1);
+    QDir outDir(arguments.at(index + 2));
+
+    setupDataSearchPaths();
+
+    SourceCodeNode algorithm;
+    if (!loadAlgorithm(fileName, algorithm)) {
+        out() << "Unable to read " << fileName << "\n";
+        out().flush();
+        return 2;
+    }
+    if (!outDir.mkpath(".")) {
+        out() << "Unable to create " << outDir.path() << "\n";
+        out().flush();
+        return 2;
+    }
+
+    QDir gd("generators:");
+    QStringList rules;
+    QStringList gens = gd.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
+    for (int g = 0; g < gens.size(); ++g)
+        rules << gd.absoluteFilePath(gens[g]);
+
+    /* the code is streamed into the files, it is never held in memory whole */
+    QString base = QFileInfo(fileName).completeBaseName();
+    QList<QSharedPointer<QSaveFile> > files;
+    QList<QSharedPointer<SourceCodeDeviceSink> > sinks;
+    QVector<SourceCodeSink *> targets;
+    QStringList opened; // the rules whose output file could be opened
+    int failures = 0;
+    for (int g = 0; g < rules.size(); ++g) {
+        QSharedPointer<QSaveFile> file(new QSaveFile(outDir.filePath(base + "." + QFileInfo(rules[g]).baseName())));
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Text)) {
+            out() << "Unable to write " << file->fileName() << "\n";
+            ++failures;
+            continue;
+        }
+        files << file;
+        sinks << QSharedPointer<SourceCodeDeviceSink>(new SourceCodeDeviceSink(file.data()));
+        targets << sinks.last().data();
+        opened << rules[g];
+    }
+    SourceCodeGenerator::generateAll(algorithm, opened, targets);
+
+    for (int g = 0; g < opened.size(); ++g) {
+        if (sinks[g]->flush() && files[g]->commit()) {
+            out() << files[g]->fileName() << "\n";
+        } else {
+            out() << "Unable to write " << files[g]->fileName() << "\n";
+            ++failures;
+        }
+    }
+    out().flush();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef GENERATEALL_H
+#define GENERATEALL_H
+
+#include <QStringList>
+
+/* Headless code generation (afce --generate-all chart.afc outdir).
+   Loads the chart once and writes the code of every generator to
+   outdir/<chart>.<generator>, the generators running in parallel. */
+int runGenerateAll(const QStringList &arguments);
+
+#endif // GENERATEALL_H
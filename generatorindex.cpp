@@ -0,0 +1,291 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+
+#include "generatorindex.h"
+#include "sourcecodegenerator.h"
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+namespace {
+
+const quint32 indexMagic = 0x41464749; // "AFGI"
+const quint16 indexVersion = 1;
+const int refreshDelay = 200; // ms, editors save in several steps
+
+QString indexFileName()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/generators.idx";
+}
+
+AfcGeneratorMap readIndex(const QString &fileName)
+{
+    AfcGeneratorMap result;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return result;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    quint32 count;
+    stream >> magic >> version >> count;
+    if (magic != indexMagic || version != indexVersion)
+        return result;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        AfcGeneratorInfo info;
+        stream >> info.path >> info.id >> info.modified >> info.size >> info.names;
+        if (stream.status() == QDataStream::Ok)
+            result.insert(info.path, info);
+    }
+    return result;
+}
+
+void writeIndex(const QString &fileName, const AfcGeneratorMap &index)
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << indexMagic << indexVersion << quint32(index.size());
+    for (AfcGeneratorMap::const_iterator it = index.constBegin(); it != index.constEnd(); ++it)
+        stream << it->path << it->id << it->modified << it->size << it->names;
+    file.commit();
+}
+
+QString absoluteDirectory(const QString &path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+/* the directory itself or its nearest ancestor that exists */
+QString existingDirectory(const QString &path)
+{
+    QString dir = absoluteDirectory(path);
+    while (!QFileInfo::exists(dir)) {
+        QString parent = QFileInfo(dir).path();
+        if (parent == dir)
+            return QString();
+        dir = parent;
+    }
+    return dir;
+}
+
+bool readInfo(const QFileInfo &fileInfo, AfcGeneratorInfo &info)
+{
+    QFile file(fileInfo.absoluteFilePath());
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    info.path = fileInfo.absoluteFilePath();
+    info.id = fileInfo.baseName();
+    info.modified = fileInfo.lastModified();
+    info.size = fileInfo.size();
+    info.names.clear();
+    QJsonObject names = QJsonDocument::fromJson(file.readAll()).object().value("name").toObject();
+    for (QJsonObject::const_iterator it = names.constBegin(); it != names.constEnd(); ++it)
+        info.names.insert(it.key(), it.value().toString());
+    return true;
+}
+
+}
+
+QString AfcGeneratorInfo::displayName(const QString &locale) const
+{
+    if (names.contains(locale))
+        return names.value(locale);
+    else if (names.contains("en_US"))
+        return names.value("en_US");
+    return id;
+}
+
+AfcGeneratorScanner::AfcGeneratorScanner(const QStringList &aDirectories, const QString &aIndexFile,
+                                         const AfcGeneratorMap &aIndex, bool aFromDisk)
+    : fDirectories(aDirectories), fIndexFile(aIndexFile), fIndex(aIndex), fFromDisk(aFromDisk)
+{
+    setAutoDelete(false);
+}
+
+void AfcGeneratorScanner::run()
+{
+    AFC_TRACE("AfcGeneratorScanner::run");
+    if (fFromDisk)
+        fIndex = readIndex(fIndexFile);
+
+    AfcGeneratorMap result;
+    for (int d = 0; d < fDirectories.size(); ++d) {
+        QFileInfoList files = QDir(fDirectories[d]).entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Name);
+        for (int f = 0; f < files.size(); ++f) {
+            QString path = files[f].absoluteFilePath();
+            if (result.contains(path))
+                continue;
+            AfcGeneratorInfo info = fIndex.value(path);
+            if (info.modified != files[f].lastModified() || info.size != files[f].size()) {
+                fChanged << path;
+                if (!readInfo(files[f], info))
+                    continue;
+            }
+            result.insert(path, info);
+        }
+    }
+    for (AfcGeneratorMap::const_iterator it = fIndex.constBegin(); it != fIndex.constEnd(); ++it) {
+        if (!result.contains(it.key()))
+            fChanged << it.key();
+    }
+
+    fIndex = result;
+    if (!fChanged.isEmpty())
+        writeIndex(fIndexFile, fIndex);
+    emit finished();
+}
+
+AfcGeneratorIndex::AfcGeneratorIndex(QObject *parent)
+    : QObject(parent), fScanner(0), fRefreshPending(false), fLoaded(false)
+{
+    fWatcher = new QFileSystemWatcher(this);
+    fRefreshTimer = new QTimer(this);
+    fRefreshTimer->setSingleShot(true);
+    fRefreshTimer->setInterval(refreshDelay);
+    connect(fRefreshTimer, SIGNAL(timeout()), SLOT(refresh()));
+    connect(fWatcher, SIGNAL(directoryChanged(QString)), SLOT(directoryChanged(QString)));
+    connect(fWatcher, SIGNAL(fileChanged(QString)), SLOT(scheduleRefresh()));
+    fPool.setMaxThreadCount(1);
+    refresh();
+}
+
+AfcGeneratorIndex::~AfcGeneratorIndex()
+{
+    if (fScanner) {
+        fPool.waitForDone();
+        delete fScanner;
+    }
+}
+
+AfcGeneratorIndex * AfcGeneratorIndex::instance()
+{
+    static AfcGeneratorIndex *index = 0;
+    if (!index)
+        index = new AfcGeneratorIndex(qApp);
+    return index;
+}
+
+void AfcGeneratorIndex::scheduleRefresh()
+{
+    fRefreshTimer->start();
+}
+
+void AfcGeneratorIndex::directoryChanged(const QString &path)
+{
+    /* the nearest existing ancestor of a missing generator directory changes
+       for many other reasons, only the creation of the next directory on the
+       way to it matters; a removed directory has to be watched again */
+    if (!QFileInfo::exists(path)) {
+        scheduleRefresh();
+        return;
+    }
+    QStringList directories = QDir::searchPaths("generators");
+    for (int i = 0; i < directories.size(); ++i) {
+        if (absoluteDirectory(directories[i]) == path) {
+            scheduleRefresh();
+            return;
+        }
+    }
+    QString prefix = path.endsWith('/') ? path : path + '/';
+    bool ancestor = false;
+    for (int i = 0; i < fMissingDirectories.size(); ++i) {
+        const QString &missing = fMissingDirectories[i];
+        if (!missing.startsWith(prefix))
+            continue;
+        ancestor = true;
+        if (QFileInfo::exists(prefix + missing.mid(prefix.size()).section('/', 0, 0))) {
+            scheduleRefresh();
+            return;
+        }
+    }
+    if (!ancestor)
+        scheduleRefresh();
+}
+
+void AfcGeneratorIndex::refresh()
+{
+    if (fScanner) {
+        fRefreshPending = true;
+        return;
+    }
+    fScanner = new AfcGeneratorScanner(QDir::searchPaths("generators"), indexFileName(), fIndex, !fLoaded);
+    connect(fScanner, SIGNAL(finished()), SLOT(scanFinished()));
+    fPool.start(fScanner);
+}
+
+void AfcGeneratorIndex::scanFinished()
+{
+    AFC_TRACE("AfcGeneratorIndex::scanFinished");
+    fIndex = fScanner->index();
+    QStringList changedFiles = fScanner->changed();
+    /* deleted once the event loop is back, finished() is the last thing
+       the scanner does on its thread */
+    fScanner->deleteLater();
+    fScanner = 0;
+    for (int i = 0; i < changedFiles.size(); ++i)
+        SourceCodeGenerator::forgetCachedRule(changedFiles[i]);
+
+    /* a generator directory that does not exist yet is watched through its
+       nearest existing ancestor, which reports when it is created; editors
+       that replace a file on save drop it from the watcher */
+    QStringList paths = fIndex.keys();
+    QStringList directories = QDir::searchPaths("generators");
+    fMissingDirectories.clear();
+    for (int i = 0; i < directories.size(); ++i) {
+        QString dir = existingDirectory(directories[i]);
+        if (dir != absoluteDirectory(directories[i]))
+            fMissingDirectories << absoluteDirectory(directories[i]);
+        if (!dir.isEmpty() && !paths.contains(dir))
+            paths << dir;
+    }
+    QStringList watched = fWatcher->files() + fWatcher->directories();
+    QStringList stale;
+    for (int i = 0; i < watched.size(); ++i) {
+        if (!paths.contains(watched[i]))
+            stale << watched[i];
+    }
+    if (!stale.isEmpty())
+        fWatcher->removePaths(stale);
+    for (int i = paths.size() - 1; i >= 0; --i) {
+        if (watched.contains(paths[i]) || !QFileInfo::exists(paths[i]))
+            paths.removeAt(i);
+    }
+    if (!paths.isEmpty())
+        fWatcher->addPaths(paths);
+
+    bool first = !fLoaded;
+    fLoaded = true;
+    if (first || !changedFiles.isEmpty())
+        emit changed();
+    if (fRefreshPending) {
+        fRefreshPending = false;
+        refresh();
+    }
+}
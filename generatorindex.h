@@ -0,0 +1,106 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef GENERATORINDEX_H
+#define GENERATORINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QRunnable>
+#include <QStringList>
+#include <QThreadPool>
+
+class QFileSystemWatcher;
+class QTimer;
+
+/* What the language list needs to know about a generator rule file. */
+struct AfcGeneratorInfo
+{
+    QString path;
+    QString id; // base name, as passed to the generators: search path
+    QDateTime modified;
+    qint64 size;
+    QHash<QString, QString> names; // by locale
+
+    AfcGeneratorInfo() : size(-1) {}
+    QString displayName(const QString &locale) const;
+};
+
+typedef QMap<QString, AfcGeneratorInfo> AfcGeneratorMap; // by path
+
+/* Brings an index up to date on a thread pool thread: the generator
+   directories are listed and only files whose modification time or size
+   differ from the index are parsed. The index is stored in the cache
+   directory, so an unchanged installation parses no rule file at startup. */
+class AfcGeneratorScanner : public QObject, public QRunnable
+{
+    Q_OBJECT
+  private:
+    QStringList fDirectories;
+    QString fIndexFile;
+    AfcGeneratorMap fIndex;
+    bool fFromDisk; // fIndex is read from fIndexFile first
+    QStringList fChanged; // parsed, added or removed files
+
+  public:
+    AfcGeneratorScanner(const QStringList &aDirectories, const QString &aIndexFile,
+                        const AfcGeneratorMap &aIndex, bool aFromDisk);
+    const AfcGeneratorMap & index() const { return fIndex; }
+    QStringList changed() const { return fChanged; }
+    void run() override;
+
+  signals:
+    void finished();
+};
+
+/* Process-wide index of the code generators, shared by all windows. The
+   generator directories and rule files are watched, edits are picked up
+   without a restart. */
+class AfcGeneratorIndex : public QObject
+{
+    Q_OBJECT
+  private:
+    AfcGeneratorMap fIndex;
+    QFileSystemWatcher *fWatcher;
+    QTimer *fRefreshTimer;
+    QThreadPool fPool; // runs the scanner, waited for on exit
+    AfcGeneratorScanner *fScanner; // running refresh, if any
+    QStringList fMissingDirectories; // generator directories watched through an ancestor
+    bool fRefreshPending;
+    bool fLoaded; // the first refresh has finished
+    explicit AfcGeneratorIndex(QObject *parent);
+
+  public:
+    ~AfcGeneratorIndex();
+    static AfcGeneratorIndex * instance();
+    QList<AfcGeneratorInfo> generators() const { return fIndex.values(); } // sorted by path
+    bool isLoaded() const { return fLoaded; }
+
+  public slots:
+    void refresh();
+
+  private slots:
+    void scheduleRefresh();
+    void directoryChanged(const QString &path);
+    void scanFinished();
+
+  signals:
+    void changed();
+};
+
+#endif // GENERATORINDEX_H
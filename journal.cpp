@@ -0,0 +1,349 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+
+#include "journal.h"
+#include "tracer.h"
+#include "zvflowchart.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QStandardPaths>
+
+namespace {
+
+const quint32 journalMagic = 0x41464a31; // "AFJ1"
+const quint16 journalVersion = 1;
+const int compactInterval = 500; // records between snapshots
+
+enum JournalOp
+{
+    opSnapshot = 1,
+    opInsert,
+    opDelete,
+    opAttributes
+};
+
+QString journalDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal";
+}
+
+QString lockFileName(const QString &journal)
+{
+    return journal + ".lock";
+}
+
+/* indexes from the root down to the block */
+QList<int> blockPath(const QBlock *block)
+{
+    QList<int> result;
+    for (; block && block->parent; block = block->parent)
+        result.prepend(block->index());
+    return result;
+}
+
+QBlock *blockAt(QBlock *root, const QList<int> &path)
+{
+    QBlock *block = root;
+    for (int i = 0; block && i < path.size(); ++i)
+        block = path[i] >= 0 && path[i] < block->items.size() ? block->item(path[i]) : 0;
+    return block;
+}
+
+QByteArray frame(const QByteArray &payload)
+{
+    QByteArray result;
+    QDataStream stream(&result, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << payload;
+    return result;
+}
+
+}
+
+void AfcJournalWriter::write(const QByteArray &aRecord, bool aCompact)
+{
+    AFC_TRACE("AfcJournalWriter::write");
+    if (aCompact)
+    {
+        /* the previous journal stays intact until the snapshot is complete */
+        fFile.close();
+        QSaveFile file(fPath);
+        if (!file.open(QIODevice::WriteOnly))
+            return;
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << journalMagic << journalVersion;
+        file.write(aRecord);
+        if (!file.commit())
+            return;
+        fFile.setFileName(fPath);
+        fFile.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+    else if (fFile.isOpen())
+    {
+        fFile.write(aRecord);
+        fFile.flush();
+    }
+}
+
+void AfcJournalWriter::writeSnapshot(const QBlock *aRoot, const QString &aFileName, bool aClean)
+{
+    AFC_TRACE("AfcJournalWriter::writeSnapshot");
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(opSnapshot) << aFileName << aClean << aRoot->toBinary();
+    write(frame(payload), true);
+}
+
+AfcJournal::AfcJournal(QFlowChart *aDocument, QObject *parent)
+    : QObject(parent), fDocument(aDocument), fWriter(0), fRecords(0), fClean(true), fSnapshotPending(false)
+{
+    /* one journal per window */
+    static int journalCount = 0;
+    QDir().mkpath(journalDirectory());
+    fPath = QString("%1/autosave-%2-%3.afcj").arg(journalDirectory())
+            .arg(QCoreApplication::applicationPid()).arg(++journalCount);
+    fLock = new QLockFile(lockFileName(fPath));
+    fLock->setStaleLockTime(0);
+    fLock->tryLock(0);
+
+    fWriter = new AfcJournalWriter(fPath);
+    fWriter->moveToThread(&fThread);
+    connect(this, SIGNAL(record(QByteArray, bool)), fWriter, SLOT(write(QByteArray, bool)));
+    fThread.start(QThread::LowPriority);
+
+    connect(fDocument, SIGNAL(blocksInserted(QBlock *, int, const QBlock *)),
+            SLOT(blocksInserted(QBlock *, int, const QBlock *)));
+    connect(fDocument, SIGNAL(blockAboutToBeDeleted(QBlock *)), SLOT(blockAboutToBeDeleted(QBlock *)));
+    connect(fDocument, SIGNAL(attributesEdited(QBlock *)), SLOT(attributesEdited(QBlock *)));
+    connect(fDocument, SIGNAL(documentReplaced()), SLOT(documentReplaced()));
+    scheduleSnapshot();
+}
+
+AfcJournal::~AfcJournal()
+{
+    fThread.quit();
+    fThread.wait();
+    delete fWriter;
+    QFile::remove(fPath);
+    delete fLock;
+}
+
+void AfcJournal::reset(const QString &aFileName, bool aClean)
+{
+    fFileName = aFileName;
+    fClean = aClean;
+    scheduleSnapshot();
+}
+
+void AfcJournal::append(const QByteArray &aRecord)
+{
+    fClean = false;
+    /* a pending snapshot already includes the edit, and writes fClean as it
+       is when the snapshot is taken */
+    if (fSnapshotPending)
+        return;
+    emit record(frame(aRecord), false);
+    if (++fRecords >= compactInterval)
+        scheduleSnapshot();
+}
+
+void AfcJournal::scheduleSnapshot()
+{
+    /* several replacements in a row (e.g. loading a file) make one snapshot */
+    if (fSnapshotPending)
+        return;
+    fSnapshotPending = true;
+    QMetaObject::invokeMethod(this, "writeSnapshot", Qt::QueuedConnection);
+}
+
+void AfcJournal::writeSnapshot()
+{
+    AFC_TRACE("AfcJournal::writeSnapshot");
+    fSnapshotPending = false;
+    fRecords = 0;
+    /* copying the tree shares the attributes, the serialization of the
+       whole document is left to the journal thread; the call is queued
+       after the records already emitted. The copy belongs to this thread
+       and is deleted here, whichever thread releases it. */
+    QSharedPointer<QBlock> root(fDocument->root()->clone(), &QObject::deleteLater);
+    AfcJournalWriter *writer = fWriter;
+    QString fileName = fFileName;
+    bool clean = fClean;
+    QMetaObject::invokeMethod(fWriter, [writer, root, fileName, clean]() {
+        writer->writeSnapshot(root.data(), fileName, clean);
+    }, Qt::QueuedConnection);
+}
+
+void AfcJournal::blocksInserted(QBlock *aBranch, int aIndex, const QBlock *aAlgorithm)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(opInsert) << blockPath(aBranch) << qint32(aIndex) << aAlgorithm->toBinary();
+    append(payload);
+}
+
+void AfcJournal::blockAboutToBeDeleted(QBlock *aBlock)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(opDelete) << blockPath(aBlock);
+    append(payload);
+}
+
+void AfcJournal::attributesEdited(QBlock *aBlock)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(opAttributes) << blockPath(aBlock) << aBlock->attributes;
+    append(payload);
+}
+
+void AfcJournal::documentReplaced()
+{
+    fClean = false;
+    scheduleSnapshot();
+}
+
+QStringList AfcJournal::orphanedJournals()
+{
+    QStringList result;
+    QDir dir(journalDirectory());
+    QFileInfoList journals = dir.entryInfoList(QStringList() << "autosave-*.afcj", QDir::Files, QDir::Time);
+    for (int i = 0; i < journals.size(); ++i)
+    {
+        /* the lock of a running session is never stale, only the lock
+           of a session that is gone can be taken over */
+        QLockFile lock(lockFileName(journals[i].absoluteFilePath()));
+        lock.setStaleLockTime(0);
+        if (lock.tryLock(0))
+            result << journals[i].absoluteFilePath();
+    }
+    return result;
+}
+
+QBlock * AfcJournal::replay(const QString &aJournal, QString &aFileName)
+{
+    AFC_TRACE("AfcJournal::replay");
+    QFile file(aJournal);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (magic != journalMagic || version != journalVersion)
+        return 0;
+
+    QBlock *root = 0;
+    bool clean = true;
+    while (!stream.atEnd())
+    {
+        /* the last record may be cut short by the crash */
+        QByteArray payload;
+        stream >> payload;
+        if (stream.status() != QDataStream::Ok)
+            break;
+        QDataStream record(payload);
+        record.setVersion(QDataStream::Qt_5_0);
+        quint8 op;
+        record >> op;
+        if (op == opSnapshot)
+        {
+            QByteArray data;
+            record >> aFileName >> clean >> data;
+            delete root;
+            root = QBlock::fromBinary(data);
+            continue;
+        }
+        if (!root)
+            break;
+
+        clean = false;
+        QList<int> path;
+        record >> path;
+        QBlock *block = blockAt(root, path);
+        if (!block || record.status() != QDataStream::Ok)
+            break;
+        if (op == opInsert)
+        {
+            qint32 index;
+            QByteArray data;
+            record >> index >> data;
+            QBlock *algorithm = QBlock::fromBinary(data);
+            if (!algorithm || index < 0 || index > block->items.size())
+            {
+                delete algorithm;
+                break;
+            }
+            block->insertTree(index, algorithm);
+            delete algorithm;
+        }
+        else if (op == opDelete)
+        {
+            /* the same as QFlowChart::deleteBlock() */
+            if (block == root)
+            {
+                for (int i = 0; i < block->items.size(); ++i)
+                    block->item(i)->clear();
+            }
+            else if (block->isBranch)
+                block->clear();
+            else
+                delete block;
+        }
+        else if (op == opAttributes)
+        {
+            QHash<QString, QString> attributes;
+            record >> attributes;
+            if (record.status() != QDataStream::Ok)
+                break;
+            block->attributes = attributes;
+            block->invalidateCaption();
+        }
+        else
+            break;
+    }
+
+    if (root && clean)
+    {
+        delete root;
+        root = 0;
+    }
+    if (root)
+    {
+        root->adjustSize(1);
+        root->adjustPosition(0, 0);
+    }
+    return root;
+}
+
+void AfcJournal::discard(const QString &aJournal)
+{
+    QFile::remove(aJournal);
+    QFile::remove(lockFileName(aJournal));
+}
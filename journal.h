@@ -0,0 +1,90 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QFile>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+
+class QBlock;
+class QFlowChart;
+class QLockFile;
+
+/* Writes journal records on the journal thread. A compacting record
+   replaces the whole file atomically, any other record is appended.
+   Snapshots are serialized here too, from a copy of the tree. */
+class AfcJournalWriter : public QObject
+{
+    Q_OBJECT
+  private:
+    QString fPath;
+    QFile fFile; // open for appending after the first snapshot
+
+  public:
+    explicit AfcJournalWriter(const QString &aPath) : fPath(aPath) {}
+
+    void writeSnapshot(const QBlock *aRoot, const QString &aFileName, bool aClean); // compacts
+
+  public slots:
+    void write(const QByteArray &aRecord, bool aCompact);
+};
+
+/* Autosave journal for crash recovery. Every edit of the document appends
+   a record with the position of the edited block and the data of the edit
+   only. Replaced documents (open, undo, redo) are written as a snapshot,
+   which also compacts the journal, as does every 500th record. Each
+   window keeps its own journal guarded by a lock file; a journal whose
+   lock is stale was left by a crashed session and can be replayed. */
+class AfcJournal : public QObject
+{
+    Q_OBJECT
+  private:
+    QFlowChart *fDocument;
+    QString fPath;
+    QString fFileName;
+    QThread fThread;
+    AfcJournalWriter *fWriter;
+    QLockFile *fLock;
+    int fRecords; // since the last snapshot
+    bool fClean; // the document matches fFileName
+    bool fSnapshotPending;
+    void append(const QByteArray &aRecord);
+    void scheduleSnapshot();
+
+  public:
+    explicit AfcJournal(QFlowChart *aDocument, QObject *parent = 0);
+    ~AfcJournal(); // a normal exit leaves no journal behind
+    void reset(const QString &aFileName, bool aClean = true); // the document was saved or loaded as aFileName
+
+    static QStringList orphanedJournals(); // left by crashed sessions, newest first
+    /* rebuilds the laid out tree kept in a journal; 0 when it holds no unsaved changes */
+    static QBlock * replay(const QString &aJournal, QString &aFileName);
+    static void discard(const QString &aJournal);
+
+  private slots:
+    void blocksInserted(QBlock *aBranch, int aIndex, const QBlock *aAlgorithm);
+    void blockAboutToBeDeleted(QBlock *aBlock);
+    void attributesEdited(QBlock *aBlock);
+    void documentReplaced();
+    void writeSnapshot();
+
+  signals:
+    void record(const QByteArray &aRecord, bool aCompact);
+};
+
+#endif // JOURNAL_H
@@ -15,13 +15,21 @@
 
 #include <QtGui>
 #include "mainwindow.h"
+#include "benchmark.h"
+#include "generateall.h"
+#include "tracer.h"
 
 int main(int argc, char *argv[])
 {
+    startStartupClock();
     QApplication app(argc, argv);
+    QString traceFile = QString::fromLocal8Bit(qgetenv("AFCE_TRACE"));
+    int traceArg = app.arguments().indexOf("--trace");
+    if (traceArg > 0 && traceArg + 1 < app.arguments().size())
+        traceFile = app.arguments().at(traceArg + 1);
+    AfcTracer::start(traceFile);
     QSettings settings("afce", "application");
     QString localeName = settings.value("locale", QLocale::system().name()).toString();
-    qDebug() << "Available languages: " << MainWindow::enumLanguages();
     setApplicationLocale(localeName);
 #if defined(Q_WS_X11) or defined(Q_OS_LINUX)
     qDebug() << "Application dir path:" << QString(PROGRAM_DATA_DIR);
@@ -29,8 +37,11 @@ int main(int argc, char *argv[])
     qDebug() << "Application dir path:" << app.applicationDirPath();
 #endif
     qDebug() << "Version: " << afceVersion();
-    qDebug() << "Supported image formats to write: " << QImageWriter::supportedImageFormats();
     QTextCodec::setCodecForLocale(QTextCodec::codecForName("utf-8"));
+    if (app.arguments().contains("--bench"))
+        return runBenchmark(app.arguments());
+    if (app.arguments().contains("--generate-all"))
+        return runGenerateAll(app.arguments());
     MainWindow w;
     w.setLocale(QLocale(localeName));
     w.show();
@@ -14,10 +14,17 @@
 ****************************************************************************/
 
 #include "mainwindow.h"
+#include "documentloader.h"
+#include "generatorindex.h"
+#include "journal.h"
+#include "tracer.h"
 #include <QtGui>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QLocale>
 #include <QSettings>
+#include <QThreadPool>
+#include <QTimer>
 #include <QTranslator>
 #include <QWidgetList>
 #include "qflowchartstyle.h"
@@ -27,6 +34,42 @@ QString afceVersion()
     return PROGRAM_VERSION;
 }
 
+namespace {
+QElapsedTimer startupClock;
+bool firstWindowCreated = false;
+}
+
+void startStartupClock()
+{
+    startupClock.start();
+}
+
+qint64 startupElapsed()
+{
+    return startupClock.isValid() ? startupClock.elapsed() : 0;
+}
+
+QString documentArgument()
+{
+    QStringList args = qApp->arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args.at(i) == "--trace")
+            ++i;
+        else if (!args.at(i).startsWith("--"))
+            return args.at(i);
+    }
+    return QString();
+}
+
+void setupDataSearchPaths()
+{
+#if defined(Q_WS_X11) or defined(Q_OS_LINUX)
+    QDir::setSearchPaths("generators", QStringList() << QString(PROGRAM_DATA_DIR) + "generators");
+#else
+    QDir::setSearchPaths("generators", QStringList() << qApp->applicationDirPath() + "/generators");
+#endif
+}
+
 
 void AfcScrollArea::mousePressEvent(QMouseEvent *event)
 {
@@ -176,13 +219,12 @@ void AfcScrollArea::wheelEvent(QWheelEvent *event)
 
 
 MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
-    : QMainWindow(parent, flags), fDocument(nullptr)
+    : QMainWindow(parent, flags), fDocument(nullptr), fLoader(nullptr), fJournal(nullptr), fRevision(0), fSavedRevision(0),
+      fStartupComplete(false), fFirstPaintTime(-1), fPrimary(!firstWindowCreated), helpWindow(nullptr)
 {
-#if defined(Q_WS_X11) or defined(Q_OS_LINUX)
-    QDir::setSearchPaths("generators", QStringList() << QString(PROGRAM_DATA_DIR) + "generators");
-#else
-    QDir::setSearchPaths("generators", QStringList() << qApp->applicationDirPath() + "/generators");
-#endif
+    firstWindowCreated = true;
+    setupDataSearchPaths();
+    fSavePool.setMaxThreadCount(1);
 
     setupUi();
     readSettings();
@@ -190,13 +232,18 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
 
     QFlowChart *fc = new QFlowChart(this);
     setDocument(fc);
+    /* generators and the help window are loaded after the first paint */
+    fc->installEventFilter(this);
+    QTimer::singleShot(1000, this, SLOT(finishStartup()));
     document()->setZoom(1);
     connect(document(), SIGNAL(statusChanged()), this, SLOT(slotStatusChanged()));
     connect(document(), SIGNAL(editBlock(QBlock *)), this, SLOT(slotEditBlock(QBlock *)));
     connect(actUndo, SIGNAL(triggered()), document(), SLOT(undo()));
     connect(actRedo, SIGNAL(triggered()), document(), SLOT(redo()));
     connect(document(), SIGNAL(changed()), this, SLOT(updateActions()));
+    connect(document(), SIGNAL(canPasteChanged(bool)), this, SLOT(updateActions()));
     connect(document(), SIGNAL(changed()), this, SLOT(generateCode()));
+    connect(actPerfOverlay, SIGNAL(toggled(bool)), document(), SLOT(setPerfOverlay(bool)));
     document()->setStatus(QFlowChart::Selectable);
     connect(saScheme, SIGNAL(mouseDown()), document(), SLOT(deselectAll()));
     connect(codeLanguage, SIGNAL(activated(int)), this, SLOT(codeLangChanged(int)));
@@ -225,13 +272,20 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     connect(this, SIGNAL(documentLoaded()), SLOT(slotDocumentLoaded()));
     connect(this, SIGNAL(documentSaved()), SLOT(slotDocumentSaved()));
 
-    if (qApp->arguments().size() > 1) {
-        QFile test(qApp->arguments().at(1));
+    /* crashed sessions and the command line concern the first window only */
+    bool recovered = fPrimary && recoverDocument();
+    fJournal = new AfcJournal(document(), this);
+    if (recovered)
+        fJournal->reset(fileName, false);
+
+    QString startupFile = fPrimary ? documentArgument() : QString();
+    if (!recovered && !startupFile.isEmpty()) {
+        QFile test(startupFile);
         if(test.exists()) {
-            slotOpenDocument(qApp->arguments().at(1));
+            slotOpenDocument(startupFile);
         }
         else {
-            QMessageBox::critical(this, tr("Failed to open a file"), tr("Unable to open file '%1'.").arg(qApp->arguments().at(1)));
+            QMessageBox::critical(this, tr("Failed to open a file"), tr("Unable to open file '%1'.").arg(startupFile));
         }
     }
 }
@@ -243,9 +297,11 @@ void MainWindow::writeSettings()
 
     settings.setValue("geometry", geometry());
     settings.setValue("windowState", saveState());
+    settings.setValue("helpVisible", helpWindow && helpWindow->isVisible());
 }
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    finishPendingSaves();
     if (okToContinue()) {
         writeSettings();
         event->accept();
@@ -286,6 +342,9 @@ void MainWindow::createActions()
     actPrint = new QAction(QIcon(":/images/print_32_h.png"), "", this);
     actTools = new QAction(QIcon(":/images/toolbar.png"), "", this);
     actCode = new QAction(QIcon(":/images/source-code.png"), "", this);
+    actPerfOverlay = new QAction(this);
+    actPerfOverlay->setCheckable(true);
+    actMemoryUsage = new QAction(this);
 
 
     connect(actExit, SIGNAL(triggered()), this, SLOT(close()));
@@ -300,6 +359,7 @@ void MainWindow::createActions()
     connect(actCopy, SIGNAL(triggered()), this, SLOT(slotEditCopy()));
     connect(actPaste, SIGNAL(triggered()), this, SLOT(slotEditPaste()));
     connect(actDelete, SIGNAL(triggered()), this, SLOT(slotEditDelete()));
+    connect(actMemoryUsage, SIGNAL(triggered()), this, SLOT(slotShowMemoryUsage()));
 
 //    connect(actHelp, SIGNAL(triggered()), this, SLOT(slotHelpHelp()));
     connect(actAbout, SIGNAL(triggered()), this, SLOT(slotHelpAbout()));
@@ -309,6 +369,14 @@ void MainWindow::createActions()
 //    connect(actTools, SIGNAL(triggered()), this, SLOT(slotTools()));
 
 
+}
+
+void MainWindow::slotPopulateLanguageMenu()
+{
+    /* the locale directory is scanned when the menu is opened first */
+    if (!actLanguages.isEmpty())
+        return;
+    AFC_TRACE("MainWindow::slotPopulateLanguageMenu");
     QHash<QString, QString> avlLangs = enumLanguages();
     QList<QString> locales = avlLangs.keys();
     for (int i = 0; i < locales.size(); ++i) {
@@ -317,13 +385,109 @@ void MainWindow::createActions()
         act->setData(locales[i]);
         actLanguages.append(act);
         connect(act, SIGNAL(triggered()), this, SLOT(slotChangeLanguage()));
+        menuLanguage->addAction(act);
+    }
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == document() && event->type() == QEvent::Paint && fFirstPaintTime < 0) {
+        fFirstPaintTime = startupElapsed();
+        document()->removeEventFilter(this);
+        /* runs once the first frame is on the screen */
+        QTimer::singleShot(0, this, SLOT(finishStartup()));
     }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::LanguageChange)
+        retranslateUi();
+    QMainWindow::changeEvent(event);
+}
 
+void MainWindow::finishStartup()
+{
+    if (fStartupComplete)
+        return;
+    AFC_TRACE("MainWindow::finishStartup");
+    fStartupComplete = true;
+    /* the generator list fills in when the index is loaded in the background */
+    AfcGeneratorIndex *generators = AfcGeneratorIndex::instance();
+    connect(generators, SIGNAL(changed()), SLOT(slotReloadGenerators()));
+    connect(generators, SIGNAL(changed()), SLOT(generateCode()));
+    slotReloadGenerators();
+    generateCode();
+    if (QSettings("afce", "application").value("helpVisible", false).toBool())
+        slotToggleHelp(true);
+    if (fPrimary && qApp->arguments().contains("--startup-time")) {
+        qDebug() << "Time to first paint:" << fFirstPaintTime << "ms";
+        qDebug() << "Startup complete:" << startupElapsed() << "ms";
+    }
 }
 
 
 MainWindow::~MainWindow()
 {
+    /* only this window's loaders are waited for, the queued finished()
+       signals are not delivered any more */
+    if (fLoader)
+        fAbandonedLoaders << fLoader;
+    for (int i = 0; i < fAbandonedLoaders.size(); ++i)
+        fAbandonedLoaders.at(i)->cancel();
+    fLoadPool.waitForDone();
+    qDeleteAll(fAbandonedLoaders);
+    /* the saves are finished and reported by closeEvent(); one started
+       afterwards is still completed, the savers are deleted with the children */
+    fSavePool.waitForDone();
+    delete fJournal;
+}
+
+bool MainWindow::recoverDocument()
+{
+    /* journals left by crashed sessions, one per window that was open; each
+       one with unsaved changes is offered, the first recovered document goes
+       to this window and every further one to a new window */
+    QStringList journals = AfcJournal::orphanedJournals();
+    bool result = false;
+    for (int i = 0; i < journals.size(); ++i)
+    {
+        QString fn;
+        QBlock *root = AfcJournal::replay(journals[i], fn);
+        if (root)
+        {
+            QString question = fn.isEmpty() ? tr("Afce was not closed properly. Do you want to recover the unsaved changes?")
+                                            : tr("Afce was not closed properly. Do you want to recover the unsaved changes in '%1'?").arg(fn);
+            if (QMessageBox::question(this, tr("Recover unsaved changes"), question,
+                                      QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
+            {
+                MainWindow *w = this;
+                if (result)
+                {
+                    w = new MainWindow();
+                    w->setAttribute(Qt::WA_DeleteOnClose);
+                }
+                w->document()->setRoot(root, 1);
+                w->fileName = fn;
+                if (!fn.isEmpty())
+                    w->setWindowTitle(tr("%1 - Algorithm Flowchart Editor").arg(fn));
+                w->isSaved = false;
+                if (w != this)
+                {
+                    w->fJournal->reset(fn, false);
+                    w->show();
+                }
+                result = true;
+            }
+            else
+                delete root;
+        }
+        /* recovered into a window with a journal of its own, declined, or
+           without unsaved changes */
+        AfcJournal::discard(journals[i]);
+    }
+    return result;
 }
 
 bool MainWindow::okToContinue()
@@ -418,6 +582,7 @@ void MainWindow::setZoom(int quarts)
     zoomLabel->setText(tr("Zoom: %1 %").arg(quarts * 25));
     if (document())
     {
+        document()->beginInteraction();
         document()->setZoom(quarts * 25 / 100.0);
     }
 }
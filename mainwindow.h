@@ -32,8 +32,13 @@
 #include <QScrollBar>
 #include <QStatusBar>
 #include <QMessageBox>
+#include <QThreadPool>
 
 
+class AfcDocumentLoader;
+class AfcDocumentSaver;
+class AfcJournal;
+
 class AfcScrollArea : public QScrollArea
 {
   Q_OBJECT
@@ -70,6 +75,18 @@ private:
 //  TAlgorithmBlock *fRoot;
   QFlowChart *fDocument;
   bool isSaved;
+  AfcDocumentLoader *fLoader; // document being loaded in the background, if any
+  QList<AfcDocumentLoader *> fAbandonedLoaders; // canceled, still running
+  QThreadPool fLoadPool; // this window's loaders only
+  AfcJournal *fJournal; // autosave for crash recovery
+  QThreadPool fSavePool; // one thread, so that saves commit in order
+  QList<AfcDocumentSaver *> fPendingSavers; // started, finished() not handled yet
+  int fRevision; // incremented on every modification
+  int fSavedRevision;
+  bool fStartupComplete; // generators and the help window are loaded
+  qint64 fFirstPaintTime; // ms since startStartupClock(), -1 before the first paint
+  bool fPrimary; // the window created at startup, later ones come from File/New
+  bool recoverDocument();
   QVBoxLayout *fVLayout;
   QHBoxLayout *fHLayout;
   AfcScrollArea *saScheme;
@@ -110,6 +127,8 @@ private:
   QAction *actPrint;
   QAction *actTools;
   QAction *actCode;
+  QAction *actPerfOverlay;
+  QAction *actMemoryUsage;
   QAction *acteng;
   QAction *actrus;
   QList<QAction *> actLanguages;
@@ -142,11 +161,17 @@ private:
   void createActions();
   void createToolbox();
   void createToolBar();
+  void createHelpWindow();
+  void retranslateHelpWindow();
  //void closeEvent(QCloseEvent *event);
   bool okToContinue();
+  void finishPendingSaves();
+  void documentSaveFinished(AfcDocumentSaver *saver);
 protected:
 
 void closeEvent(QCloseEvent *event);
+bool eventFilter(QObject *watched, QEvent *event) override;
+void changeEvent(QEvent *event) override;
 
 public:
     MainWindow(QWidget *parent = nullptr, Qt::WindowFlags flags = Qt::WindowFlags());
@@ -188,8 +213,14 @@ public slots:
   void slotDocumentSaved();
   void slotDocumentChanged();
   void slotDocumentLoaded();
+  void slotDocumentLoadFinished();
+  void slotDocumentSaveFinished();
   void slotChangeLanguage();
   void slotReloadGenerators();
+  void slotShowMemoryUsage();
+  void slotPopulateLanguageMenu();
+  void finishStartup();
+  void slotToggleHelp(bool aVisible);
 
   void setZoom(int quarts);
   void shiftZoom(int step);
@@ -213,6 +244,10 @@ signals:
 };
 
 QString afceVersion();
+void setupDataSearchPaths();
+QString documentArgument();
 void setApplicationLocale(const QString &localeName);
+void startStartupClock(); // called first thing in main()
+qint64 startupElapsed(); // ms since startStartupClock()
 
 #endif // MAINWINDOW_H
@@ -115,9 +115,10 @@ void MainWindow::slotEditBlock(QBlock *aBlock)
                 {
                     aBlock->flowChart()->makeUndo();
                     aBlock->attributes[attr] = text->text();
+                    aBlock->invalidateCaption();
                     aBlock->flowChart()->realignObjects();
                     aBlock->flowChart()->update();
-                    aBlock->flowChart()->makeChanged();
+                    aBlock->flowChart()->blockChanged(aBlock);
                 }
             }
         }
@@ -165,9 +166,10 @@ void MainWindow::slotEditBlock(QBlock *aBlock)
                     aBlock->attributes["var"] = teVar->text();
                     aBlock->attributes["from"] = teFrom->text();
                     aBlock->attributes["to"] = teTo->text();
+                    aBlock->invalidateCaption();
                     aBlock->flowChart()->realignObjects();
                     aBlock->flowChart()->update();
-                    aBlock->flowChart()->makeChanged();
+                    aBlock->flowChart()->blockChanged(aBlock);
                 }
             }
         }
@@ -204,9 +206,10 @@ void MainWindow::slotEditBlock(QBlock *aBlock)
                 {
                     aBlock->flowChart()->makeUndo();
                     aBlock->attributes["vars"] = te->toPlainText().split("\n", Qt::SkipEmptyParts).join(",");
+                    aBlock->invalidateCaption();
                     aBlock->flowChart()->realignObjects();
                     aBlock->flowChart()->update();
-                    aBlock->flowChart()->makeChanged();
+                    aBlock->flowChart()->blockChanged(aBlock);
                 }
             }
         }
@@ -247,9 +250,10 @@ void MainWindow::slotEditBlock(QBlock *aBlock)
                     aBlock->flowChart()->makeUndo();
                     aBlock->attributes["dest"] = leDest->text();
                     aBlock->attributes["src"] = leSrc->text();
+                    aBlock->invalidateCaption();
                     aBlock->flowChart()->realignObjects();
                     aBlock->flowChart()->update();
-                    aBlock->flowChart()->makeChanged();
+                    aBlock->flowChart()->blockChanged(aBlock);
                 }
             }
         }
@@ -262,7 +266,7 @@ void MainWindow::slotToolAssign()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><assign dest=\"x\" src=\"0\"/></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -283,7 +287,7 @@ void MainWindow::slotToolProcess()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><process text=\"func()\"/></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -296,7 +300,7 @@ void MainWindow::slotToolIf()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><if cond=\"x &gt; 0\"><branch /><branch /></if></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -309,7 +313,7 @@ void MainWindow::slotToolFor()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><for var=\"i\" from=\"0\" to=\"n - 1\"><branch /></for></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -322,7 +326,7 @@ void MainWindow::slotToolWhilePre()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><pre cond=\"x &lt; n\"><branch /></pre></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -335,7 +339,7 @@ void MainWindow::slotToolWhilePost()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><post cond=\"x &lt; n\"><branch /></post></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -349,7 +353,7 @@ void MainWindow::slotToolIo()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><io vars=\"x,y\"/></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -366,7 +370,7 @@ void MainWindow::slotToolOu()
     if(document())
     {
         document()->setBuffer("<algorithm><branch><ou vars=\"x,y\"/></branch></algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -380,7 +384,7 @@ void MainWindow::slotToolCase()
     //  if(document())
     //  {
     //    document()->setBuffer("<algorithm><branch><case><branch /><branch /><branch /></case></branch></algorithm>");
-    //    if(!document()->buffer().isEmpty())
+    //    if(document()->hasBuffer())
     //    {
     //      document()->setStatus(QFlowChart::Insertion);
     //      document()->setMultiInsert(false);
@@ -394,7 +398,7 @@ void MainWindow::slotToolForCStyle()
     if(document())
     {
         document()->setBuffer("<algorithm> <branch> <assign dest=\"i\" src=\"0\"  /> <pre cond=\"i &lt; n\"> <branch> <assign dest=\"i\" src=\"i + 1\" /> </branch> </pre> </branch> </algorithm>");
-        if(!document()->buffer().isEmpty())
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
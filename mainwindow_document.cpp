@@ -14,19 +14,23 @@
 ****************************************************************************/
 
 #include "mainwindow.h"
+#include "documentloader.h"
+#include "documentsaver.h"
+#include "generatorindex.h"
 #include "sourcecodegenerator.h"
+#include "tracer.h"
 #include <QtGui>
 #include <QtSvg>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QImageWriter>
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QLocale>
-#include <QProcess>
+#include <QProgressDialog>
 #include <QRegExp>
 #include <QSettings>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QtPrintSupport/QPrinter>
 #include <QtPrintSupport/QPrintDialog>
 
@@ -47,22 +51,69 @@ void MainWindow::slotFileOpen()
 }
 
 void MainWindow::slotOpenDocument(const QString &fn) {
-    emit documentUnloaded();
-    fileName = fn;
-    setWindowTitle(tr("%1 - Algorithm Flowchart Editor").arg(fileName));
-    QFile xml(fileName);
-    if (xml.exists())
+    AFC_TRACE("MainWindow::slotOpenDocument");
+    if (fLoader)
     {
-        xml.open(QIODevice::ReadOnly | QIODevice::Text);
-        QDomDocument doc;
-        if (doc.setContent(&xml, false))
+        /* a newer request wins, the abandoned loader is deleted when it finishes */
+        fLoader->cancel();
+        fAbandonedLoaders << fLoader;
+        fLoader = nullptr;
+    }
+    if (!QFile::exists(fn))
+    {
+        emit documentUnloaded();
+        fileName = fn;
+        setWindowTitle(tr("%1 - Algorithm Flowchart Editor").arg(fileName));
+        emit documentLoaded();
+        return;
+    }
+
+    /* reading, parsing and the first layout run on a worker thread,
+       only the finished tree is swapped into the document here */
+    fLoader = new AfcDocumentLoader(fn);
+    QProgressDialog *progress = new QProgressDialog(tr("Loading %1...").arg(QFileInfo(fn).fileName()),
+                                                    tr("Cancel"), 0, 100, this);
+    progress->setWindowModality(Qt::WindowModal);
+    progress->setMinimumDuration(500);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(fLoader, SIGNAL(progress(int)), progress, SLOT(setValue(int)));
+    connect(fLoader, SIGNAL(finished()), progress, SLOT(close()));
+    connect(progress, SIGNAL(canceled()), fLoader, SLOT(cancel()));
+    connect(fLoader, SIGNAL(finished()), SLOT(slotDocumentLoadFinished()));
+    fLoadPool.start(fLoader);
+}
+
+void MainWindow::slotDocumentLoadFinished()
+{
+    AfcDocumentLoader *loader = qobject_cast<AfcDocumentLoader *>(sender());
+    if (!loader)
+        return;
+    if (loader == fLoader)
+    {
+        fLoader = nullptr;
+        if (!loader->isCanceled())
         {
-            document()->root()->setXmlNode(doc.firstChildElement());
-            document()->setZoom(1);
+            QBlock *root = loader->takeRoot();
+            if (root)
+            {
+                emit documentUnloaded();
+                fileName = loader->fileName();
+                setWindowTitle(tr("%1 - Algorithm Flowchart Editor").arg(fileName));
+                document()->setRoot(root, 1);
+                emit documentLoaded();
+            }
+            else
+            {
+                QMessageBox::critical(this, tr("Failed to open a file"), tr("Unable to open file '%1'.").arg(loader->fileName()));
+            }
         }
     }
-    emit documentLoaded();
-
+    else
+    {
+        fAbandonedLoaders.removeOne(loader);
+    }
+    /* the worker thread may still be returning from emitting finished() */
+    loader->deleteLater();
 }
 
 void MainWindow::slotFilePrint()
@@ -71,6 +122,7 @@ void MainWindow::slotFilePrint()
     QPrintDialog pd(&printer, this);
     if (pd.exec() == QDialog::Accepted)
     {
+        AFC_TRACE("MainWindow::slotFilePrint");
         double oldZoom = document()->zoom();
         document()->setZoom(1);
         document()->setStatus(QFlowChart::Display);
@@ -98,7 +150,14 @@ void MainWindow::slotFilePrint()
 
 void MainWindow::slotFileNew()
 {
-    QProcess::startDetached(QApplication::applicationFilePath());
+    /* a new window in the same process shares the translations, the parsed
+       generators and the help index, so it opens without a process startup */
+    AFC_TRACE("MainWindow::slotFileNew");
+    MainWindow *w = new MainWindow();
+    w->setAttribute(Qt::WA_DeleteOnClose);
+    w->setLocale(locale());
+    w->move(pos() + QPoint(32, 32));
+    w->show();
 }
 
 void MainWindow::slotFileSave()
@@ -109,16 +168,53 @@ void MainWindow::slotFileSave()
     }
     else
     {
-        QDomDocument doc = document()->document();
-        QString xmlString = doc.toString(2);
-        QFile xml(fileName);
-        xml.open(QIODevice::ReadWrite | QIODevice::Text | QIODevice::Truncate);
-        QTextStream stream(&xml);
-        stream.setCodec(QTextCodec::codecForName("utf-8"));
-        stream << xmlString;
-        xml.close();
-        emit documentSaved();
+        AFC_TRACE("MainWindow::slotFileSave");
+        /* only the copy of the tree is taken here, serialization and
+           writing run on the save thread */
+        AfcDocumentSaver *saver = new AfcDocumentSaver(fileName, document()->root()->clone(), fRevision, this);
+        connect(saver, SIGNAL(finished()), SLOT(slotDocumentSaveFinished()));
+        fPendingSavers << saver;
+        statusBar()->showMessage(tr("Saving %1...").arg(QFileInfo(fileName).fileName()));
+        fSavePool.start(saver);
+    }
+}
+
+void MainWindow::slotDocumentSaveFinished()
+{
+    AfcDocumentSaver *saver = qobject_cast<AfcDocumentSaver *>(sender());
+    /* already handled by finishPendingSaves() */
+    if (!saver || !fPendingSavers.contains(saver))
+        return;
+    documentSaveFinished(saver);
+}
+
+void MainWindow::finishPendingSaves()
+{
+    /* waits for the saves still running, so that a failure is reported and
+       a completed save counts before the window asks about unsaved changes */
+    if (fPendingSavers.isEmpty())
+        return;
+    fSavePool.waitForDone();
+    while (!fPendingSavers.isEmpty())
+        documentSaveFinished(fPendingSavers.first());
+}
+
+void MainWindow::documentSaveFinished(AfcDocumentSaver *saver)
+{
+    fPendingSavers.removeOne(saver);
+    statusBar()->clearMessage();
+    if (saver->isSucceeded())
+    {
+        fSavedRevision = saver->revision();
+        if (saver->fileName() == fileName)
+            emit documentSaved();
+    }
+    else
+    {
+        QMessageBox::critical(this, tr("Failed to save a file"),
+                              tr("Unable to save file '%1': %2").arg(saver->fileName(), saver->errorString()));
     }
+    saver->deleteLater();
 }
 
 void MainWindow::slotFileSaveAs()
@@ -134,23 +230,29 @@ void MainWindow::slotFileSaveAs()
 }
 
 void MainWindow::slotDocumentSaved() {
-    isSaved = true;
+    /* the document may have been edited while it was being saved */
+    isSaved = fSavedRevision == fRevision;
+    if (fJournal)
+        fJournal->reset(fileName, isSaved);
 }
 
 void MainWindow::slotDocumentChanged() {
     isSaved = false;
+    ++fRevision;
 }
 
 void MainWindow::slotDocumentLoaded() {
     isSaved = true;
+    if (fJournal)
+        fJournal->reset(fileName);
 }
 
 void MainWindow::slotChangeLanguage()
 {
     QAction * action = (QAction *)sender();
     QString localeName = action->data().toString();
+    /* every window is retranslated by its changeEvent() */
     setApplicationLocale(localeName);
-    retranslateUi();
 
     QSettings settings("afce", "application");
     settings.setValue("locale", localeName);
@@ -158,32 +260,16 @@ void MainWindow::slotChangeLanguage()
 
 void MainWindow::slotReloadGenerators()
 {
-    int i = codeLanguage->currentIndex();
+    /* the names come from the generator index, no rule file is parsed here */
+    QString current = codeLanguage->itemData(codeLanguage->currentIndex()).toString();
     codeLanguage->clear();
-    QDir gd("generators:");
-    QStringList gens = gd.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
-
+    QList<AfcGeneratorInfo> gens = AfcGeneratorIndex::instance()->generators();
+    QString loc = QLocale().name();
     for (int g = 0; g < gens.size(); ++g) {
-        QFile f(gd.absoluteFilePath(gens[g]));
-        QString lang_name = QFileInfo(f.fileName()).baseName();
-        if(f.open(QIODevice::ReadOnly|QIODevice::Text)) {
-            QJsonDocument json = QJsonDocument::fromJson(f.readAll());
-            f.close();
-            QJsonObject obj = json.object();
-            QString loc = QLocale().name();
-            if(obj.contains("name")) {
-                QJsonObject jn = obj.value("name").toObject();
-                if(jn.contains(loc)) {
-                    lang_name = jn.value(loc).toString();
-                }
-                else if (jn.contains("en_US")) {
-                    lang_name = jn.value("en_US").toString();
-                }
-            }
-            codeLanguage->addItem(lang_name, QFileInfo(f.fileName()).baseName());
-        }
+        codeLanguage->addItem(gens[g].displayName(loc), gens[g].id);
     }
 
+    int i = codeLanguage->findData(current);
     if (i!=-1)
         codeLanguage->setCurrentIndex(i);
     else
@@ -192,6 +278,14 @@ void MainWindow::slotReloadGenerators()
 }
 
 
+void MainWindow::slotShowMemoryUsage()
+{
+    if (document())
+    {
+        QMessageBox::information(this, tr("Memory usage"), document()->memoryUsage().toString());
+    }
+}
+
 void MainWindow::slotFileExport()
 {
     QString filter = getWriteFormatFilter();
@@ -220,6 +314,7 @@ void MainWindow::slotFileExport()
                 fn += masks.first().toLower();
             }
         }
+        AFC_TRACE("MainWindow::slotFileExport");
         double oldZoom = document()->zoom();
         document()->setZoom(1);
         document()->setStatus(QFlowChart::Display);
@@ -244,6 +339,7 @@ void MainWindow::slotFileExportSVG()
     if(!fn.isEmpty())
     {
         if(fn.right(4).toLower() != ".svg") fn += ".svg";
+        AFC_TRACE("MainWindow::slotFileExportSVG");
         double oldZoom = document()->zoom();
         document()->setZoom(1);
         document()->setStatus(QFlowChart::Display);
@@ -276,29 +372,26 @@ void MainWindow::slotEditCopy()
     {
         if(document()->activeBlock())
         {
-            QDomDocument doc("AFC"); // do not localize!
-            QDomElement block = document()->activeBlock()->xmlNode(doc);
-            if (document()->activeBlock()->isBranch)
+            /* the copy is wrapped into an algorithm like a chart file */
+            QBlock *algorithm = document()->activeBlock()->clone();
+            if (algorithm->isBranch)
             {
-                QDomElement alg = doc.createElement("algorithm");
-                alg.appendChild(block);
-                doc.appendChild(alg);
+                QBlock *alg = new QBlock("algorithm");
+                alg->append(algorithm);
+                algorithm = alg;
             }
-            else
+            else if (algorithm->type() != "algorithm")
             {
-                if(block.nodeName() != "algorithm")
-                {
-                    QDomElement alg = doc.createElement("algorithm");
-                    QDomElement branch = doc.createElement("branch");
-                    alg.appendChild(branch);
-                    branch.appendChild(block);
-                    doc.appendChild(alg);
-                }
-                else
-                    doc.appendChild(block);
+                QBlock *branch = new QBlock("branch");
+                branch->isBranch = true;
+                branch->append(algorithm);
+                QBlock *alg = new QBlock("algorithm");
+                alg->append(branch);
+                algorithm = alg;
             }
             QClipboard *clipbrd = QApplication::clipboard();
-            clipbrd->setText(doc.toString(2));
+            clipbrd->setMimeData(new QFlowChartMimeData(algorithm));
+            delete algorithm;
             updateActions();
         }
     }
@@ -309,8 +402,8 @@ void MainWindow::slotEditPaste()
     if(document())
     {
         QClipboard *clipbrd = QApplication::clipboard();
-        document()->setBuffer(clipbrd->text());
-        if(!document()->buffer().isEmpty())
+        document()->setBufferData(clipbrd->mimeData());
+        if(document()->hasBuffer())
         {
             document()->setStatus(QFlowChart::Insertion);
             document()->setMultiInsert(false);
@@ -338,9 +431,13 @@ void MainWindow::generateCode()
 {
     if (document() && codeLanguage->currentIndex() >= 0)
     {
+        AFC_TRACE("MainWindow::generateCode");
+        QElapsedTimer timer;
+        timer.start();
         SourceCodeGenerator gen;
         gen.loadRule("generators:" + codeLanguage->itemData(codeLanguage->currentIndex()).toString() + ".json");
         codeText->setText(gen.applyRule(document()->document()));
+        document()->setCodegenTime(timer.nsecsElapsed() / 1000000.0);
     }
 }
 
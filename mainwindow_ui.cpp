@@ -14,6 +14,7 @@
 ****************************************************************************/
 
 #include "mainwindow.h"
+#include "tracer.h"
 #include <QtGui>
 #include <QMenu>
 #include <QMenuBar>
@@ -85,19 +86,43 @@ void MainWindow::setupUi()
     codeWidget->setLayout(vbl);
     dockCode->setWidget(codeWidget);
 
+    actHelp->setCheckable(true);
+    connect(actHelp, SIGNAL(triggered(bool)), this, SLOT(slotToggleHelp(bool)));
+}
+
+void MainWindow::createHelpWindow()
+{
+    /* the help window is created when it is opened first */
+    AFC_TRACE("MainWindow::createHelpWindow");
     helpWindow = new THelpWindow();
     helpWindow->setObjectName("help_window");
     helpWindow->setAllowedAreas(Qt::AllDockWidgetAreas);
     addDockWidget(Qt::RightDockWidgetArea, helpWindow);
     helpWindow->hide();
+    /* the dock did not exist yet when the window state was restored */
+    restoreDockWidget(helpWindow);
+    retranslateHelpWindow();
 
-    actHelp->setCheckable(true);
-    actHelp->setChecked(helpWindow->isVisible());
-
-    connect(actHelp, SIGNAL(triggered(bool)), helpWindow, SLOT(setVisible(bool)));
     connect(helpWindow, SIGNAL(visibilityChanged(bool)), actHelp, SLOT(setChecked(bool)));
+}
 
+void MainWindow::retranslateHelpWindow()
+{
+    helpWindow->setWindowTitle(tr("Help window"));
+  #if defined(Q_WS_X11) or defined(Q_OS_LINUX)
+    helpWindow->setHelpPaths(QStringList() << QString(PROGRAM_DATA_DIR) + "help/"+QLocale().name() << QString(PROGRAM_DATA_DIR) + "help/en_US");
+  #else
+    helpWindow->setHelpPaths(QStringList() << "./help/"+QLocale().name() << "./help/en_US");
+  #endif
+}
 
+void MainWindow::slotToggleHelp(bool aVisible)
+{
+    if (!helpWindow && !aVisible)
+        return;
+    if (!helpWindow)
+        createHelpWindow();
+    helpWindow->setVisible(aVisible);
 }
 
 QToolButton * createToolButton(const QString & fileName)
@@ -222,6 +247,10 @@ void MainWindow::retranslateUi()
     actTools->setStatusTip(tr("Toggle the tool panel"));
     actCode->setText(tr("&Source code"));
     actCode->setStatusTip(tr("Toggle the source code panel"));
+    actPerfOverlay->setText(tr("&Performance overlay"));
+    actPerfOverlay->setStatusTip(tr("Show paint, layout and code generation timings over the flowchart"));
+    actMemoryUsage->setText(tr("&Memory usage..."));
+    actMemoryUsage->setStatusTip(tr("Show how much memory the document uses"));
 
 
 
@@ -239,6 +268,7 @@ void MainWindow::retranslateUi()
     actPrint->setShortcut(tr("Ctrl+P"));
     actTools->setShortcut(tr("F2"));
     actCode->setShortcut(tr("F3"));
+    actPerfOverlay->setShortcut(tr("F12"));
 
     menuFile->setTitle(tr("&File"));
     menuEdit->setTitle(tr("&Edit"));
@@ -250,7 +280,8 @@ void MainWindow::retranslateUi()
     dockCode->setWindowTitle(tr("Source code"));
     
 
-    slotReloadGenerators();
+    if (fStartupComplete)
+        slotReloadGenerators();
 
     codeLabel->setText(tr("&Select programming language:"));
 
@@ -258,12 +289,8 @@ void MainWindow::retranslateUi()
         setWindowTitle(tr("%1 - Algorithm Flowchart Editor").arg(fileName));
     else
         setWindowTitle(tr("Algorithm Flowchart Editor"));
-    helpWindow->setWindowTitle(tr("Help window"));
-    helpWindow->textBrowser->setSearchPaths(QStringList() << "./help/"+QLocale().name() << "./help/en_US");
-  #if defined(Q_WS_X11) or defined(Q_OS_LINUX)
-    helpWindow->textBrowser->setSearchPaths(QStringList() << QString(PROGRAM_DATA_DIR) + "help/"+QLocale().name() << QString(PROGRAM_DATA_DIR) + "help/en_US");
-  #endif
-    helpWindow->textBrowser->reload();
+    if (helpWindow)
+        retranslateHelpWindow();
 
 
 }
@@ -299,11 +326,11 @@ void MainWindow::createMenu()
     menuWindow = menuBar()->addMenu("");
     menuWindow->addAction(actTools);
     menuWindow->addAction(actCode);
+    menuWindow->addAction(actPerfOverlay);
+    menuWindow->addAction(actMemoryUsage);
     menuWindow->addSeparator();
     menuLanguage = menuWindow->addMenu(tr("&Language"));
-    for (int i = 0; i < actLanguages.size(); ++i) {
-        menuLanguage->addAction(actLanguages[i]);
-    }
+    connect(menuLanguage, SIGNAL(aboutToShow()), this, SLOT(slotPopulateLanguageMenu()));
 
     menuHelp = menuBar()->addMenu("");
     menuHelp->addAction(actHelp);
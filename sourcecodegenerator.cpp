@@ -4,6 +4,34 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDebug>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include "tracer.h"
+
+namespace {
+QMutex ruleCacheMutex;
+QHash<QString, QJsonDocument> ruleCache;
+
+/* one generator of SourceCodeGenerator::generateAll() */
+class GeneratorTask : public QRunnable
+{
+    const SourceCodeNode &fAlgorithm;
+    QString fRuleFile;
+    SourceCodeSink *fSink;
+public:
+    GeneratorTask(const SourceCodeNode &aAlgorithm, const QString &aRuleFile, SourceCodeSink *aSink)
+        : fAlgorithm(aAlgorithm), fRuleFile(aRuleFile), fSink(aSink) {}
+    void run() override {
+        AFC_TRACE("SourceCodeGenerator::applyRule");
+        SourceCodeGenerator gen;
+        gen.loadRule(fRuleFile);
+        gen.applyRule(fAlgorithm, *fSink);
+    }
+};
+}
 
 SourceCodeGenerator::SourceCodeGenerator(QObject *parent) :
     QObject(parent)
@@ -14,15 +42,30 @@ SourceCodeGenerator::SourceCodeGenerator(QObject *parent) :
 SourceCodeGenerator::~SourceCodeGenerator() {
 }
 
-void SourceCodeGenerator::loadRule(const QString &fileName) {
-    QFile f(fileName);
+QJsonDocument SourceCodeGenerator::cachedRule(const QString &fileName) {
+    QString path = QFileInfo(fileName).absoluteFilePath();
+    QMutexLocker lock(&ruleCacheMutex);
+    QHash<QString, QJsonDocument>::const_iterator it = ruleCache.constFind(path);
+    if (it != ruleCache.constEnd())
+        return it.value();
 
-    if (f.open(QIODevice::ReadOnly)) {
-        QByteArray data = f.readAll();
-        f.close();
-        ruleFromJSON(data);
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error: Unable to load rules from file " << fileName;
+        return QJsonDocument();
     }
-    else qDebug() << "Error: Unable to load rules from file " << fileName;
+    QJsonDocument result = QJsonDocument::fromJson(f.readAll());
+    ruleCache.insert(path, result);
+    return result;
+}
+
+void SourceCodeGenerator::forgetCachedRule(const QString &fileName) {
+    QMutexLocker lock(&ruleCacheMutex);
+    ruleCache.remove(QFileInfo(fileName).absoluteFilePath());
+}
+
+void SourceCodeGenerator::loadRule(const QString &fileName) {
+    rule = cachedRule(fileName);
 }
 
 void SourceCodeGenerator::ruleFromJSON(const QByteArray &json) {
@@ -30,76 +73,194 @@ void SourceCodeGenerator::ruleFromJSON(const QByteArray &json) {
 }
 
 QString SourceCodeGenerator::applyRule(const QDomDocument &xml) {
-    QDomElement alg = xml.firstChildElement("algorithm");
-    QString code = processElement(alg, 0);
-    return code;
+    return applyRule(SourceCodeNode::fromDocument(xml));
 }
 
-QString SourceCodeGenerator::processElement(const QDomNode &element, int level) {
-    QJsonObject obj = rule.object().value(element.nodeName()).toObject();
-    QString sp;
-    if (rule.object().contains("additional_settings")) {
-        /* if json specified indentation string it will use */
-        sp = rule.object().value("additional_settings").toObject()["indentation_preference"].toString();
-    }
-    else {
-        /* otherwise use default */
-        sp = QString("  ");
-    }
-    sp = sp.repeated(level);
+QString SourceCodeGenerator::applyRule(const SourceCodeNode &algorithm) const {
+    SourceCodeStringSink code;
+    applyRule(algorithm, code);
+    return code.text();
+}
+
+void SourceCodeGenerator::applyRule(const SourceCodeNode &algorithm, SourceCodeSink &sink) const {
+    SourceCodeWriter writer(sink, indentation());
+    writeElement(algorithm, writer);
+}
+
+QMap<QString, QString> SourceCodeGenerator::generateAll(const SourceCodeNode &algorithm, const QStringList &ruleFiles) {
+    QVector<SourceCodeStringSink> codes(ruleFiles.size());
+    QVector<SourceCodeSink *> sinks;
+    for (int i = 0; i < codes.size(); ++i)
+        sinks << &codes[i];
+    generateAll(algorithm, ruleFiles, sinks);
+
+    QMap<QString, QString> result;
+    for (int i = 0; i < ruleFiles.size(); ++i)
+        result.insert(ruleFiles[i], codes[i].text());
+    return result;
+}
+
+void SourceCodeGenerator::generateAll(const SourceCodeNode &algorithm, const QStringList &ruleFiles,
+                                      const QVector<SourceCodeSink *> &sinks) {
+    AFC_TRACE("SourceCodeGenerator::generateAll");
+    QThreadPool pool;
+    for (int i = 0; i < ruleFiles.size() && i < sinks.size(); ++i)
+        pool.start(new GeneratorTask(algorithm, ruleFiles[i], sinks[i]));
+    pool.waitForDone();
+}
+
+SourceCodeDeviceSink::SourceCodeDeviceSink(QIODevice *device) : fStream(device) {
+    fStream.setCodec("UTF-8");
+}
+
+bool SourceCodeDeviceSink::flush() {
+    fStream.flush();
+    return fStream.status() == QTextStream::Ok;
+}
+
+SourceCodeNode::SourceCodeNode(const QDomNode &node) : name(node.nodeName()) {
+    QDomNamedNodeMap attrs = node.attributes();
+    attributes.reserve(attrs.size());
+    for (int i = 0; i < attrs.size(); ++i)
+        attributes.append(qMakePair(attrs.item(i).nodeName(), attrs.item(i).nodeValue()));
+    QDomNodeList nodes = node.childNodes();
+    children.reserve(nodes.size());
+    for (int i = 0; i < nodes.size(); ++i)
+        children.append(SourceCodeNode(nodes.item(i)));
+}
+
+SourceCodeNode SourceCodeNode::fromDocument(const QDomDocument &xml) {
+    AFC_TRACE("SourceCodeNode::fromDocument");
+    return SourceCodeNode(xml.firstChildElement("algorithm"));
+}
+
+/* the text of the element itself, with the branch placeholders left in
+   and without indentation */
+QString SourceCodeGenerator::elementTemplate(const SourceCodeNode &element) const {
+    QJsonObject obj = rule.object().value(element.name).toObject();
 
     bool else_present = false;
     /* if element is "if" AND second item (number 1) is branch AND it is NOT empty mean "else" is present */
-    if (element.nodeName() == "if" && element.childNodes().item(1).nodeName() == "branch") {
-        if (element.childNodes().item(1).childNodes().size() > 0) {
+    if (element.name == "if" && element.children.size() > 1 && element.children.at(1).name == "branch") {
+        if (element.children.at(1).children.size() > 0) {
             else_present = true;
         }
     }
 
     QString tpl;
     if (obj.contains("template_shortened") && else_present == false) {
-        tpl = sp+obj.value("template_shortened").toString();
+        tpl = obj.value("template_shortened").toString();
     }
     else {
-        tpl = sp+obj.value("template").toString();
+        tpl = obj.value("template").toString();
     }
 
-    for(int i = 0; i < element.attributes().size(); ++i) {
+    for(int i = 0; i < element.attributes.size(); ++i) {
+       const QString &attrName = element.attributes.at(i).first;
+       const QString &attrValue = element.attributes.at(i).second;
        if(obj.contains("list")) {
-           QJsonArray list = obj["list"].toArray();
-           if (list.contains(QJsonValue(element.attributes().item(i).nodeName()))) {
-                QStringList sl = element.attributes().item(i).nodeValue().split(obj["separator"].toString(), QString::SkipEmptyParts);
-                QString prefix = obj["prefix"].toString();
-                QString suffix = obj["suffix"].toString();
+           QJsonArray list = obj.value("list").toArray();
+           if (list.contains(QJsonValue(attrName))) {
+                QStringList sl = attrValue.split(obj.value("separator").toString(), QString::SkipEmptyParts);
+                QString prefix = obj.value("prefix").toString();
+                QString suffix = obj.value("suffix").toString();
                 for(int k=0; k < sl.size(); ++k) {
                     QString s = sl[k];
                     s = prefix + s + suffix;
                     s.replace("%$%", sl[k]);
                     sl[k] = s;
                 }
-                tpl.replace("%"+element.attributes().item(i).nodeName() + "%", sl.join(obj["glue"].toString()));
+                tpl.replace("%"+attrName + "%", sl.join(obj.value("glue").toString()));
            }
-           tpl.replace("%"+element.attributes().item(i).nodeName() + "%", element.attributes().item(i).nodeValue());
+           tpl.replace("%"+attrName + "%", attrValue);
        }
        else
-           tpl.replace("%"+element.attributes().item(i).nodeName() + "%", element.attributes().item(i).nodeValue());
+           tpl.replace("%"+attrName + "%", attrValue);
 
     }
-    tpl.replace("\n","\n" + sp);
-    tpl.replace("\t", sp);
-
-    for(int i = 0; i < element.childNodes().size(); ++i) {
-        if (element.childNodes().item(i).nodeName() == "branch") {
-            QDomNode branch = element.childNodes().item(i);
-            QString bt = QString("%branch%1%").arg(i + 1);
-            QStringList body;
-            for(int j = 0; j < branch.childNodes().size(); ++j) {
-
-                body << processElement(branch.childNodes().item(j), level + 1);
-            }
-            tpl.replace(bt, "\n" + body.join("\n"));
+    return tpl;
+}
+
+QString SourceCodeGenerator::indentation() const {
+    if (rule.object().contains("additional_settings")) {
+        /* if json specified indentation string it will use */
+        return rule.object().value("additional_settings").toObject().value("indentation_preference").toString();
+    }
+    /* otherwise use default */
+    return QString("  ");
+}
+
+void SourceCodeGenerator::writeElement(const SourceCodeNode &element, SourceCodeWriter &writer) const {
+    QString tpl = elementTemplate(element);
+
+    /* every branch is written where its placeholder is, instead of being
+       built as a string and replaced into the template of the parent */
+    writer.writeIndentation();
+    int from = 0;
+    int pos = tpl.indexOf("%branch");
+    while (pos >= 0) {
+        int end = pos + 7;
+        while (end < tpl.size() && tpl.at(end) >= '0' && tpl.at(end) <= '9')
+            ++end;
+        int k = 0;
+        if (end < tpl.size() && tpl.at(end) == '%' && tpl.at(pos + 7) != '0')
+            k = tpl.midRef(pos + 7, end - pos - 7).toInt();
+        if (k < 1 || k > element.children.size() || element.children.at(k - 1).name != "branch") {
+            pos = tpl.indexOf("%branch", pos + 1);
+            continue;
+        }
+        writer.writeTemplate(tpl, from, pos);
+        const SourceCodeNode &branch = element.children.at(k - 1);
+        /* the children indent their own lines */
+        writer.write("\n");
+        writer.enter();
+        for (int j = 0; j < branch.children.size(); ++j) {
+            if (j > 0)
+                writer.write("\n");
+            writeElement(branch.children.at(j), writer);
         }
+        writer.leave();
+        from = end + 1;
+        pos = tpl.indexOf("%branch", from);
     }
-    return tpl;
+    writer.writeTemplate(tpl, from, tpl.size());
+}
 
+SourceCodeWriter::SourceCodeWriter(SourceCodeSink &aSink, const QString &aUnit)
+    : fSink(aSink), fUnit(aUnit), fDepth(0) {
+    fSpaces << QString();
+    fIndents << QString();
+}
+
+void SourceCodeWriter::enter() {
+    ++fDepth;
+    if (fDepth == fSpaces.size()) {
+        /* each depth is built once from the previous one */
+        QString spaces = fSpaces.last() + fUnit;
+        QString indent = spaces;
+        fSpaces << spaces;
+        fIndents << indent.replace("\t", spaces);
+    }
+}
+
+void SourceCodeWriter::writeTemplate(const QString &text, int from, int to) {
+    /* a line break continues at the current depth, a tab stands for the
+       indentation of the current depth */
+    int start = from;
+    for (int i = from; i < to; ++i) {
+        QChar c = text.at(i);
+        if (c != '\n' && c != '\t')
+            continue;
+        if (i > start)
+            fSink.write(text.mid(start, i - start));
+        if (c == '\n') {
+            fSink.write("\n");
+            writeIndentation();
+        }
+        else if (!fSpaces.at(fDepth).isEmpty())
+            fSink.write(fSpaces.at(fDepth));
+        start = i + 1;
+    }
+    if (to > start)
+        fSink.write(text.mid(start, to - start));
 }
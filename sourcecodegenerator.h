@@ -7,6 +7,74 @@
 #include <QJsonArray>
 #include <QDomElement>
 #include <QDomDocument>
+#include <QMap>
+#include <QPair>
+#include <QTextStream>
+#include <QVector>
+
+class QIODevice;
+
+/* Plain copy of a chart document for code generation. A QDomDocument can
+   not be read from several threads, this tree is built once and then
+   shared read-only by any number of generators running in parallel. */
+struct SourceCodeNode
+{
+    QString name;
+    QVector<QPair<QString, QString> > attributes; // in the order of QDomNamedNodeMap
+    QVector<SourceCodeNode> children;
+
+    SourceCodeNode() {}
+    explicit SourceCodeNode(const QDomNode &node);
+    static SourceCodeNode fromDocument(const QDomDocument &xml); // the algorithm element
+};
+
+/* Receives the generated code piece by piece, in order. */
+class SourceCodeSink
+{
+public:
+    virtual ~SourceCodeSink() {}
+    virtual void write(const QString &text) = 0;
+};
+
+class SourceCodeStringSink : public SourceCodeSink
+{
+private:
+    QString fText;
+public:
+    void write(const QString &text) override { fText += text; }
+    QString text() const { return fText; }
+};
+
+/* Writes UTF-8 to an open device, e.g. a file or a QBuffer. */
+class SourceCodeDeviceSink : public SourceCodeSink
+{
+private:
+    QTextStream fStream;
+public:
+    explicit SourceCodeDeviceSink(QIODevice *device);
+    void write(const QString &text) override { fStream << text; }
+    bool flush(); // false on a write error
+};
+
+/* Indents the code written to a sink. The depth is tracked while the
+   document is walked, so every line is indented once, when it is written,
+   whatever the nesting. */
+class SourceCodeWriter
+{
+private:
+    SourceCodeSink &fSink;
+    QString fUnit;
+    int fDepth;
+    QVector<QString> fSpaces; // fUnit repeated, by depth
+    QVector<QString> fIndents; // the line indentation (tabs in fUnit expanded), by depth
+public:
+    SourceCodeWriter(SourceCodeSink &aSink, const QString &aUnit);
+    void enter(); // one level deeper
+    void leave() { --fDepth; }
+    void write(const QString &text) { fSink.write(text); }
+    void writeIndentation() { if (!fIndents.at(fDepth).isEmpty()) fSink.write(fIndents.at(fDepth)); }
+    void writeTemplate(const QString &text, int from, int to); // expands line breaks and tabs
+};
 
 class SourceCodeGenerator : public QObject
 {
@@ -14,12 +82,25 @@ class SourceCodeGenerator : public QObject
 private:
     QJsonDocument rule;
 
-    QString processElement(const QDomNode &element, int level);
+    QString elementTemplate(const SourceCodeNode &element) const;
+    QString indentation() const;
+    void writeElement(const SourceCodeNode &element, SourceCodeWriter &writer) const;
 public:
     explicit SourceCodeGenerator(QObject *parent = 0);
     ~SourceCodeGenerator();
 
+    /* rule files are parsed once per process and shared by all windows */
+    static QJsonDocument cachedRule(const QString &fileName);
+    static void forgetCachedRule(const QString &fileName); // the file has changed
+
     QString applyRule(const QDomDocument &xml);
+    QString applyRule(const SourceCodeNode &algorithm) const;
+    void applyRule(const SourceCodeNode &algorithm, SourceCodeSink &sink) const;
+    /* applies every rule file to the same document concurrently; the
+       result maps each rule file to its code */
+    static QMap<QString, QString> generateAll(const SourceCodeNode &algorithm, const QStringList &ruleFiles);
+    static void generateAll(const SourceCodeNode &algorithm, const QStringList &ruleFiles,
+                            const QVector<SourceCodeSink *> &sinks); // one sink per rule file
 signals:
 
 public slots:
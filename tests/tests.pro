@@ -0,0 +1,31 @@
+# Regression tests and micro-benchmarks for the layout, painting and code
+# generation. Run them with "make check" here or in the top level build.
+
+TEMPLATE = app
+TARGET = tst_afce
+
+QT += gui
+QT += xml
+QT += widgets
+QT += testlib
+
+CONFIG += testcase \
+    console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+DEFINES += AFCE_TESTS_DIR=\\\"$$PWD\\\"
+
+SOURCES += tst_afce.cpp \
+    ../zvflowchart_core.cpp \
+    ../zvflowchart_interaction.cpp \
+    ../zvflowchart_layout.cpp \
+    ../zvflowchart_paint.cpp \
+    ../qflowchartstyle.cpp \
+    ../sourcecodegenerator.cpp \
+    ../tracer.cpp
+
+HEADERS += ../zvflowchart.h \
+    ../qflowchartstyle.h \
+    ../sourcecodegenerator.h \
+    ../tracer.h
@@ -0,0 +1,278 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#include "zvflowchart.h"
+#include "sourcecodegenerator.h"
+
+#include <QApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QSet>
+#include <QTextStream>
+#include <QtTest>
+
+namespace {
+
+const int maxPaintExtent = 4096;
+
+QString digest(const QByteArray &data)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex().left(16));
+}
+
+void appendGeometry(const QBlock *block, QByteArray &data)
+{
+    data += QString("%1 %2 %3 %4 %5\n").arg(block->type())
+            .arg(block->x, 0, 'f', 2).arg(block->y, 0, 'f', 2)
+            .arg(block->width, 0, 'f', 2).arg(block->height, 0, 'f', 2).toUtf8();
+    for (int i = 0; i < block->items.size(); ++i)
+        appendGeometry(block->item(i), data);
+}
+
+QString readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromUtf8(file.readAll());
+}
+
+void loadChart(QFlowChart &chart, const QString &fileName)
+{
+    chart.setStatus(QFlowChart::Display);
+    chart.fromString(readFile(fileName));
+}
+
+}
+
+/* Pins the layout and the generated code of the charts in tests/corpus to
+   the digests in tests/expected/digests.txt, and times the hot paths with
+   QBENCHMARK. The digests file has the format written by
+   afce --bench --write-baseline; only its layout and code digests are
+   checked here. Captions in the corpus are narrower than the minimum block
+   width, so the layout does not depend on the installed fonts. */
+class tst_Afce : public QObject
+{
+    Q_OBJECT
+
+  private:
+    QStringList fCharts;
+    QStringList fRules;
+    QMap<QString, QString> fExpected;
+
+    static QString chartName(const QString &fileName) { return QFileInfo(fileName).fileName(); }
+    static QString ruleId(const QString &fileName) { return QFileInfo(fileName).baseName(); }
+    void addChartRows();
+    void addCodeRows();
+
+  private slots:
+    void initTestCase();
+    void expectedDigests();
+    void layout_data() { addChartRows(); }
+    void layout();
+    void code_data() { addCodeRows(); }
+    void code();
+
+    void benchLoad_data() { addChartRows(); }
+    void benchLoad();
+    void benchRealign_data() { addChartRows(); }
+    void benchRealign();
+    void benchPaint_data() { addChartRows(); }
+    void benchPaint();
+    void benchToString_data() { addChartRows(); }
+    void benchToString();
+    void benchCodeTree_data() { addChartRows(); }
+    void benchCodeTree();
+    void benchCodegen_data() { addCodeRows(); }
+    void benchCodegen();
+};
+
+void tst_Afce::initTestCase()
+{
+    QDir corpus(QString(AFCE_TESTS_DIR) + "/corpus");
+    QStringList charts = corpus.entryList(QStringList() << "*.afc", QDir::Files, QDir::Name);
+    for (int i = 0; i < charts.size(); ++i)
+        fCharts << corpus.absoluteFilePath(charts[i]);
+    QDir generators(QString(AFCE_TESTS_DIR) + "/../generators");
+    QStringList rules = generators.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
+    for (int i = 0; i < rules.size(); ++i)
+        fRules << generators.absoluteFilePath(rules[i]);
+    QVERIFY2(!fCharts.isEmpty(), qPrintable("No charts in " + corpus.path()));
+    QVERIFY2(!fRules.isEmpty(), qPrintable("No generators in " + generators.path()));
+
+    QFile file(QString(AFCE_TESTS_DIR) + "/expected/digests.txt");
+    QVERIFY2(file.open(QIODevice::ReadOnly | QIODevice::Text), qPrintable("Unable to read " + file.fileName()));
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QStringList fields = stream.readLine().split('\t');
+        if (fields.size() == 2 && (fields[0].endsWith("/layout") || fields[0].contains("/code/")))
+            fExpected.insert(fields[0], fields[1]);
+    }
+}
+
+void tst_Afce::addChartRows()
+{
+    QTest::addColumn<QString>("chart");
+    for (int i = 0; i < fCharts.size(); ++i)
+        QTest::newRow(qPrintable(chartName(fCharts[i]))) << fCharts[i];
+}
+
+void tst_Afce::addCodeRows()
+{
+    QTest::addColumn<QString>("chart");
+    QTest::addColumn<QString>("rule");
+    for (int i = 0; i < fCharts.size(); ++i) {
+        for (int j = 0; j < fRules.size(); ++j)
+            QTest::newRow(qPrintable(chartName(fCharts[i]) + "/" + ruleId(fRules[j]))) << fCharts[i] << fRules[j];
+    }
+}
+
+/* a chart or a generator that is added, removed or renamed must come with
+   its digests, otherwise it would silently escape the pinning */
+void tst_Afce::expectedDigests()
+{
+    QSet<QString> keys;
+    for (int i = 0; i < fCharts.size(); ++i) {
+        keys.insert(chartName(fCharts[i]) + "/layout");
+        for (int j = 0; j < fRules.size(); ++j)
+            keys.insert(chartName(fCharts[i]) + "/code/" + ruleId(fRules[j]));
+    }
+    QStringList missing, extra;
+    for (QSet<QString>::const_iterator it = keys.constBegin(); it != keys.constEnd(); ++it) {
+        if (!fExpected.contains(*it))
+            missing << *it;
+    }
+    for (QMap<QString, QString>::const_iterator it = fExpected.constBegin(); it != fExpected.constEnd(); ++it) {
+        if (!keys.contains(it.key()))
+            extra << it.key();
+    }
+    missing.sort();
+    QVERIFY2(missing.isEmpty(), qPrintable("No expected digest for " + missing.join(", ")));
+    QVERIFY2(extra.isEmpty(), qPrintable("Expected digest without a chart or a generator: " + extra.join(", ")));
+}
+
+void tst_Afce::layout()
+{
+    QFETCH(QString, chart);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    QByteArray geometry;
+    appendGeometry(fc.root(), geometry);
+    QCOMPARE(digest(geometry), fExpected.value(chartName(chart) + "/layout"));
+}
+
+void tst_Afce::code()
+{
+    QFETCH(QString, chart);
+    QFETCH(QString, rule);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    SourceCodeGenerator gen;
+    gen.loadRule(rule);
+    QString code = gen.applyRule(SourceCodeNode::fromDocument(fc.document()));
+    QCOMPARE(digest(code.toUtf8()), fExpected.value(chartName(chart) + "/code/" + ruleId(rule)));
+}
+
+void tst_Afce::benchLoad()
+{
+    QFETCH(QString, chart);
+    QString contents = readFile(chart);
+    QFlowChart fc;
+    fc.setStatus(QFlowChart::Display);
+    QBENCHMARK {
+        fc.fromString(contents);
+    }
+}
+
+void tst_Afce::benchRealign()
+{
+    QFETCH(QString, chart);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    QBENCHMARK {
+        fc.realignObjects();
+    }
+}
+
+void tst_Afce::benchPaint()
+{
+    QFETCH(QString, chart);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    QBlock *r = fc.root();
+    QImage img(qBound(1, int(r->width), maxPaintExtent), qBound(1, int(r->height), maxPaintExtent),
+               QImage::Format_ARGB32_Premultiplied);
+    QBENCHMARK {
+        img.fill(0);
+        QPainter canvas(&img);
+        canvas.setRenderHint(QPainter::Antialiasing);
+        fc.paintTo(&canvas);
+    }
+}
+
+void tst_Afce::benchToString()
+{
+    QFETCH(QString, chart);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    QString xml;
+    QBENCHMARK {
+        xml = fc.toString();
+    }
+    QVERIFY(!xml.isEmpty());
+}
+
+void tst_Afce::benchCodeTree()
+{
+    QFETCH(QString, chart);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    QDomDocument doc = fc.document();
+    QBENCHMARK {
+        SourceCodeNode::fromDocument(doc);
+    }
+}
+
+void tst_Afce::benchCodegen()
+{
+    QFETCH(QString, chart);
+    QFETCH(QString, rule);
+    QFlowChart fc;
+    loadChart(fc, chart);
+    SourceCodeNode algorithm = SourceCodeNode::fromDocument(fc.document());
+    SourceCodeGenerator gen;
+    gen.loadRule(rule);
+    QString code;
+    QBENCHMARK {
+        code = gen.applyRule(algorithm);
+    }
+    QVERIFY(!code.isEmpty());
+}
+
+int main(int argc, char *argv[])
+{
+    /* the tests paint into images only, so they run without a display */
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    tst_Afce test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_afce.moc"
@@ -14,9 +14,146 @@
 ****************************************************************************/
 
 #include "thelpwindow.h"
+#include "tracer.h"
 #include <QLocale>
 #include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QRegExp>
+#include <QSet>
+#include <QThreadPool>
+#include <algorithm>
 
+namespace {
+
+QStringList tokenize(const QString &text)
+{
+  QStringList result;
+  int start = -1;
+  for (int i = 0; i <= text.size(); ++i)
+  {
+    bool letter = i < text.size() && text.at(i).isLetterOrNumber();
+    if (letter && start < 0)
+    {
+      start = i;
+    }
+    else if (!letter && start >= 0)
+    {
+      result << text.mid(start, i - start).toLower();
+      start = -1;
+    }
+  }
+  return result;
+}
+
+/* the visible text of a help page */
+QString plainText(QString html, QString &title)
+{
+  QRegExp rxTitle("<title>(.*)</title>", Qt::CaseInsensitive);
+  rxTitle.setMinimal(true);
+  title = rxTitle.indexIn(html) >= 0 ? rxTitle.cap(1).simplified() : QString();
+
+  QRegExp rxHead("<(head|style|script)[^>]*>.*</\\1>", Qt::CaseInsensitive);
+  rxHead.setMinimal(true);
+  html.remove(rxHead);
+  html.replace(QRegExp("<[^>]*>"), " ");
+  html.replace("&lt;", "<").replace("&gt;", ">").replace("&amp;", "&");
+  html.replace(QRegExp("&#?[a-zA-Z0-9]+;"), " ");
+  return html;
+}
+
+}
+
+QList<int> THelpIndex::search(const QString &query) const
+{
+  /* every word of the query has to occur in a page, the last one may be
+     incomplete and matches as a prefix */
+  QStringList terms = tokenize(query);
+  QHash<int, int> scores;
+  for (int t = 0; t < terms.size(); ++t)
+  {
+    bool prefix = t + 1 == terms.size();
+    QHash<int, int> matches;
+    QMap<QString, QHash<int, int> >::const_iterator it = words.lowerBound(terms[t]);
+    for (; it != words.constEnd() && (prefix ? it.key().startsWith(terms[t]) : it.key() == terms[t]); ++it)
+    {
+      for (QHash<int, int>::const_iterator p = it.value().constBegin(); p != it.value().constEnd(); ++p)
+      {
+        matches[p.key()] += p.value();
+      }
+    }
+    if (t == 0)
+    {
+      scores = matches;
+      continue;
+    }
+    for (QHash<int, int>::iterator s = scores.begin(); s != scores.end(); )
+    {
+      if (matches.contains(s.key()))
+      {
+        s.value() += matches.value(s.key());
+        ++s;
+      }
+      else s = scores.erase(s);
+    }
+  }
+
+  QList<QPair<int, int> > ranked;
+  for (QHash<int, int>::const_iterator s = scores.constBegin(); s != scores.constEnd(); ++s)
+  {
+    ranked << qMakePair(-s.value(), s.key());
+  }
+  std::sort(ranked.begin(), ranked.end());
+  QList<int> result;
+  for (int i = 0; i < ranked.size(); ++i)
+  {
+    result << ranked[i].second;
+  }
+  return result;
+}
+
+THelpIndexer::THelpIndexer(const QStringList &aSearchPaths, const QSharedPointer<THelpIndex> &aIndex)
+  : fSearchPaths(aSearchPaths), fIndex(aIndex)
+{
+  setAutoDelete(false);
+  connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
+}
+
+void THelpIndexer::run()
+{
+  AFC_TRACE("THelpIndexer::run");
+  /* like QTextBrowser, a page of an earlier search path hides the pages
+     with the same name in the later ones */
+  QSet<QString> seen;
+  for (int d = 0; d < fSearchPaths.size(); ++d)
+  {
+    QDir dir(fSearchPaths[d]);
+    QStringList files = dir.entryList(QStringList() << "*.html", QDir::Files, QDir::Name);
+    for (int f = 0; f < files.size(); ++f)
+    {
+      if (seen.contains(files[f])) continue;
+      seen.insert(files[f]);
+      QFile file(dir.absoluteFilePath(files[f]));
+      if (!file.open(QIODevice::ReadOnly)) continue;
+      QString title;
+      QStringList terms = tokenize(plainText(QString::fromUtf8(file.readAll()), title));
+      int page = fIndex->pages.size();
+      fIndex->pages << files[f];
+      fIndex->titles << (title.isEmpty() ? files[f] : title);
+      for (int t = 0; t < terms.size(); ++t)
+      {
+        ++fIndex->words[terms[t]][page];
+      }
+    }
+  }
+  fIndex->complete.storeRelease(1);
+  emit finished();
+}
+
+
+QHash<QString, QSharedPointer<THelpIndex> > THelpWindow::fIndexes;
 
 THelpWindow::THelpWindow()
 {
@@ -25,9 +162,15 @@ THelpWindow::THelpWindow()
   toolBar = new QToolBar;
   toolBar->setObjectName("help_toolbar");
   textBrowser = new QTextBrowser;
+  fSearchEdit = new QLineEdit;
+  fSearchEdit->setPlaceholderText(tr("Search"));
+  fSearchEdit->setClearButtonEnabled(true);
+  fResults = new QListWidget;
+  fResults->hide();
   QVBoxLayout *vl = new QVBoxLayout;
   vl->addWidget(toolBar);
-  vl->addWidget(textBrowser);
+  vl->addWidget(fResults);
+  vl->addWidget(textBrowser, 1);
   widget()->setLayout(vl);
   textBrowser->setSearchPaths(QStringList() << qApp->applicationDirPath() + "/help/"+QLocale().name() << qApp->applicationDirPath() + "/help/en_US");
 #if defined(Q_WS_X11) or defined(Q_OS_LINUX)
@@ -39,6 +182,74 @@ THelpWindow::THelpWindow()
   toolBar->addAction(QIcon(":/images/forward_16_h.png"), tr("Forward"), textBrowser, SLOT(forward()));
   toolBar->addSeparator();
   toolBar->addAction(QIcon(":/images/home_16_h.png"), tr("Home"), this, SLOT(home()));
+  toolBar->addSeparator();
+  toolBar->addWidget(fSearchEdit);
+  connect(fSearchEdit, SIGNAL(textChanged(QString)), this, SLOT(search(QString)));
+  connect(fResults, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(openResult(QListWidgetItem*)));
+  connect(fResults, SIGNAL(itemClicked(QListWidgetItem*)), this, SLOT(openResult(QListWidgetItem*)));
+}
+
+void THelpWindow::setHelpPaths(const QStringList &aSearchPaths)
+{
+  textBrowser->setSearchPaths(aSearchPaths);
+  textBrowser->reload();
+
+  /* the pages are indexed in the background once per locale */
+  QString key = aSearchPaths.join("\n");
+  if (fIndex) disconnect(fIndex.data(), SIGNAL(completed()), this, SLOT(indexFinished()));
+  fIndex = fIndexes.value(key);
+  if (!fIndex)
+  {
+    fIndex = QSharedPointer<THelpIndex>(new THelpIndex);
+    fIndexes.insert(key, fIndex);
+    THelpIndexer *indexer = new THelpIndexer(aSearchPaths, fIndex);
+    connect(indexer, SIGNAL(finished()), fIndex.data(), SIGNAL(completed()));
+    QThreadPool::globalInstance()->start(indexer);
+  }
+  if (!fIndex->complete.loadAcquire())
+  {
+    connect(fIndex.data(), SIGNAL(completed()), this, SLOT(indexFinished()));
+  }
+  search(fSearchEdit->text());
+}
+
+void THelpWindow::search(const QString &aQuery)
+{
+  fResults->clear();
+  fResults->setVisible(!aQuery.trimmed().isEmpty());
+  if (aQuery.trimmed().isEmpty()) return;
+  if (!fIndex || !fIndex->complete.loadAcquire())
+  {
+    QListWidgetItem *item = new QListWidgetItem(tr("Indexing..."), fResults);
+    item->setFlags(Qt::NoItemFlags);
+    return;
+  }
+  AFC_TRACE("THelpWindow::search");
+  QList<int> pages = fIndex->search(aQuery);
+  for (int i = 0; i < pages.size(); ++i)
+  {
+    QListWidgetItem *item = new QListWidgetItem(fIndex->titles.at(pages[i]), fResults);
+    item->setData(Qt::UserRole, fIndex->pages.at(pages[i]));
+  }
+  if (pages.isEmpty())
+  {
+    QListWidgetItem *item = new QListWidgetItem(tr("Nothing found"), fResults);
+    item->setFlags(Qt::NoItemFlags);
+  }
+}
+
+void THelpWindow::openResult(QListWidgetItem *aItem)
+{
+  QString page = aItem ? aItem->data(Qt::UserRole).toString() : QString();
+  if (!page.isEmpty())
+  {
+    textBrowser->setSource(QUrl(page));
+  }
+}
+
+void THelpWindow::indexFinished()
+{
+  search(fSearchEdit->text());
 }
 
 void THelpWindow::hideEvent(QHideEvent *)
@@ -23,6 +23,51 @@
 #include <QTextBrowser>
 #include <QVBoxLayout>
 #include <QIcon>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMap>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QStringList>
+
+class QLineEdit;
+class QListWidget;
+class QListWidgetItem;
+
+/* Inverted index over the help pages of one locale: every word maps to
+   the pages it occurs in and the number of occurrences. completed() is
+   emitted in the GUI thread to every window sharing the index. */
+class THelpIndex : public QObject
+{
+    Q_OBJECT
+public:
+    QStringList pages; // file names relative to the search paths
+    QStringList titles;
+    QMap<QString, QHash<int, int> > words; // sorted, so prefixes are ranges
+    QAtomicInt complete;
+
+    QList<int> search(const QString &query) const; // page numbers, best first
+
+signals:
+    void completed();
+};
+
+/* Builds a THelpIndex on a thread pool thread. The indexer is not deleted
+   automatically, it deletes itself later in response to finished(). */
+class THelpIndexer : public QObject, public QRunnable
+{
+    Q_OBJECT
+private:
+    QStringList fSearchPaths;
+    QSharedPointer<THelpIndex> fIndex;
+
+public:
+    THelpIndexer(const QStringList &aSearchPaths, const QSharedPointer<THelpIndex> &aIndex);
+    void run() override;
+
+signals:
+    void finished();
+};
 
 class THelpWindow : public QDockWidget
 {
@@ -34,15 +79,25 @@ public:
     QTextBrowser *textBrowser;
 
     THelpWindow();
+    void setHelpPaths(const QStringList &aSearchPaths);
 
 private:
     QFrame *fWidget;
     QToolBar *toolBar;
+    QLineEdit *fSearchEdit;
+    QListWidget *fResults;
+    static QHash<QString, QSharedPointer<THelpIndex> > fIndexes; // by search paths, built once per locale and shared by all windows
+    QSharedPointer<THelpIndex> fIndex;
 
     void hideEvent(QHideEvent *);
 
 public slots:
     void home();
+
+private slots:
+    void search(const QString &aQuery);
+    void openResult(QListWidgetItem *aItem);
+    void indexFinished();
 };
 
 #endif // THELPWINDOW_H
@@ -0,0 +1,99 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+namespace {
+struct TraceEvent
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+QMutex traceMutex;
+QElapsedTimer traceClock;
+QString traceFileName;
+QVector<TraceEvent> traceEvents;
+QHash<Qt::HANDLE, int> traceThreads;
+}
+
+QAtomicInt AfcTracer::fEnabled(0);
+
+void AfcTracer::start(const QString &fileName)
+{
+    if (isEnabled() || fileName.isEmpty())
+        return;
+    traceFileName = fileName;
+    traceEvents.reserve(4096);
+    traceClock.start();
+    fEnabled.storeRelease(1);
+    qAddPostRoutine(AfcTracer::finish);
+    qDebug() << "Tracing to" << fileName;
+}
+
+qint64 AfcTracer::now()
+{
+    return traceClock.nsecsElapsed() / 1000;
+}
+
+void AfcTracer::addEvent(const char *name, qint64 start, qint64 duration)
+{
+    QMutexLocker lock(&traceMutex);
+    Qt::HANDLE id = QThread::currentThreadId();
+    QHash<Qt::HANDLE, int>::const_iterator it = traceThreads.constFind(id);
+    int thread = it != traceThreads.constEnd() ? it.value() : traceThreads.insert(id, traceThreads.size() + 1).value();
+    TraceEvent event = { name, start, duration, thread };
+    traceEvents.append(event);
+}
+
+void AfcTracer::finish()
+{
+    if (!isEnabled())
+        return;
+    /* runs before QCoreApplication stops the global pool, the tasks still
+       running there must not record into the events being written */
+    QThreadPool::globalInstance()->waitForDone();
+    QMutexLocker lock(&traceMutex);
+    fEnabled.storeRelease(0);
+
+    QFile file(traceFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Error: Unable to write trace to" << traceFileName;
+        return;
+    }
+    QTextStream stream(&file);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent &e = traceEvents.at(i);
+        stream << "{\"name\":\"" << e.name << "\",\"cat\":\"afce\",\"ph\":\"X\",\"pid\":1"
+               << ",\"tid\":" << e.thread << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << "}"
+               << (i + 1 < traceEvents.size() ? ",\n" : "\n");
+    }
+    stream << "]}\n";
+    traceEvents.clear();
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**                                                                         **
+** Copyright (C) 2009-2014 Victor Zinkevich. All rights reserved.          **
+** Contact: vicking@yandex.ru                                              **
+**                                                                         **
+** This file is part of the Algorithm Flowchart Editor project.            **
+**                                                                         **
+** This file may be used under the terms of the GNU                        **
+** General Public License versions 2.0 or 3.0 as published by the Free     **
+** Software Foundation and appearing in the file LICENSE included in       **
+** the packaging of this file.                                             **
+** You can find license at http://www.gnu.org/licenses/gpl.html            **
+**                                                                         **
+****************************************************************************/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QAtomicInt>
+#include <QString>
+
+/* Opt-in tracing of hot paths. It is enabled by the AFCE_TRACE environment
+   variable or by the --trace command line option, both naming the output
+   file. The file is written in Chrome trace event format on exit and can
+   be opened in chrome://tracing or https://ui.perfetto.dev */
+class AfcTracer
+{
+  private:
+    /* read from any thread; set by start() before any worker runs and
+       cleared by finish() once the workers are done */
+    static QAtomicInt fEnabled;
+
+  public:
+    static bool isEnabled() { return fEnabled.loadAcquire() != 0; }
+    static void start(const QString &fileName);
+    static void finish();
+    static qint64 now();
+    static void addEvent(const char *name, qint64 start, qint64 duration);
+};
+
+/* Records the lifetime of the enclosing scope as a trace event.
+   The name must be a string literal. */
+class AfcTraceScope
+{
+  private:
+    const char *fName;
+    qint64 fStart;
+
+  public:
+    explicit AfcTraceScope(const char *aName)
+        : fName(aName), fStart(AfcTracer::isEnabled() ? AfcTracer::now() : -1) {}
+    ~AfcTraceScope()
+    {
+        if (fStart >= 0)
+            AfcTracer::addEvent(fName, fStart, AfcTracer::now() - fStart);
+    }
+};
+
+#define AFC_TRACE(name) AfcTraceScope afcTraceScope(name)
+
+#endif // TRACER_H
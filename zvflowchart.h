@@ -24,9 +24,11 @@
 #include "qflowchartstyle.h"
 
 #define AFC_VERSION "1.2"
+#define AFC_BLOCKS_MIME_TYPE "application/x-afce-blocks"
 
 class QBlock;
 class QFlowChart;
+class QFlowChartPerfOverlay;
 //class QBranch;
 
 class QInsertionPoint
@@ -42,6 +44,8 @@ class QInsertionPoint
       fBranch = 0;
       fIndex = -1;
     }
+    QInsertionPoint(QBlock *aBranch, int aIndex, const QPointF &aPoint)
+      : fPoint(aPoint), fBranch(aBranch), fIndex(aIndex) {}
     QPointF point() const { return fPoint; }
     QBlock *branch() const { return fBranch; }
     int index() const { return fIndex; }
@@ -53,12 +57,103 @@ class QInsertionPoint
 
 Q_DECLARE_TYPEINFO(QInsertionPoint, Q_MOVABLE_TYPE);
 
+/* Fonts, pens, brushes and captions prepared once for a paint device,
+   zoom and chart style, and shared by all blocks while painting.
+   On screen the level of detail drops at low zoom and while the view
+   is being scrolled or zoomed; exports and printing are always full. */
+class QFlowChartRenderContext
+{
+  public:
+    double zoom;
+    int dpi;
+    bool fontSizeInPoints;
+    bool screen;
+    bool interacting;
+    bool drawText;
+    bool drawShadows;
+    bool drawArrows;
+    bool drawOutlines; // blocks are reduced to the rectangles they occupy
+    double lineWidth;
+    double shadowOffset;
+    QFont font;
+    QPen normalPen;
+    QPen selectedPen;
+    QBrush normalBrush;
+    QBrush selectedBrush;
+    QBrush shadowBrush;
+    QSize bottomArrow;
+    QSize rightArrow;
+    QString beginText;
+    QString endText;
+    QString yesText;
+    QString noText;
+
+    QFlowChartRenderContext()
+      : zoom(0), dpi(0), fontSizeInPoints(false), screen(false), interacting(false),
+        drawText(true), drawShadows(true), drawArrows(true), drawOutlines(false), lineWidth(0), shadowOffset(0) {}
+};
+
+/* Caption of a block prepared once per change of its attributes: the text,
+   the width measured by the layout pass and the text shaped for painting. */
+class QBlockCaption
+{
+  public:
+    QString text;
+    QFont measureFont;
+    int measuredWidth; // -1 until measured with measureFont
+    QFont paintFont;
+    double paintWidth; // wrapping width, -1 for a single line
+    QStaticText staticText;
+    bool prepared;
+    bool textValid; // text matches the attributes, see QBlock::invalidateCaption()
+
+    QBlockCaption() : measuredWidth(-1), paintWidth(-1), prepared(false), textValid(false) {}
+    void setText(const QString &aText)
+    {
+      if (aText != text)
+      {
+        text = aText;
+        measuredWidth = -1;
+        prepared = false;
+      }
+    }
+};
+
+/* Estimated memory held by a document, in bytes. Strings are counted by
+   their capacity, implicitly shared data is counted for every owner. */
+struct QFlowChartMemoryUsage
+{
+  Q_DECLARE_TR_FUNCTIONS(QFlowChartMemoryUsage)
+
+public:
+  int blocks;
+  qint64 blockBytes;
+  qint64 attributeBytes;
+  qint64 captionBytes;
+  qint64 undoBytes;
+  qint64 redoBytes;
+  qint64 bufferBytes;
+  qint64 cacheBytes;
+
+  QFlowChartMemoryUsage()
+    : blocks(0), blockBytes(0), attributeBytes(0), captionBytes(0), undoBytes(0), redoBytes(0), bufferBytes(0), cacheBytes(0) {}
+  qint64 total() const { return blockBytes + attributeBytes + captionBytes + undoBytes + redoBytes + bufferBytes + cacheBytes; }
+  QString toString() const;
+};
+
 
 class QBlock : public QObject
 {
   Q_OBJECT
   private:
     QFlowChart *fFlowChart;
+    mutable QBlockCaption fCaption;
+    bool fSelected; // the block or one of its ancestors is selected
+    int fIndex; // position in parent->items, kept by insert() and remove()
+    void renumber(int aFrom);
+    void insertDetached(int aIndex, const QList<QBlock *> &aBlocks); // renumbers once
+    void updateCaptionText() const;
+    void deleteItems();
 
   public:
     QBlock();
@@ -72,8 +167,8 @@ class QBlock : public QObject
     bool isBranch;
     QBlock *root();
     QString type() const { return attributes.value("type", QString()); }
-    void setType(const QString & newType) { attributes["type"] = newType; }
-    int index();
+    void setType(const QString & newType) { attributes["type"] = newType; invalidateCaption(); }
+    int index() const { return parent ? fIndex : -1; }
     void insert(int newIndex, QBlock *aBlock);
     void remove(QBlock *aBlock);
     void append(QBlock *aBlock);
@@ -86,21 +181,52 @@ class QBlock : public QObject
     void adjustSize(const double aZoom);
     void adjustPosition(const double ox, const double oy);
     void paint(QPainter *canvas, bool fontSizeInPoints = false) const;
+    void paint(QPainter *canvas, const QFlowChartRenderContext &rc) const;
     double zoom() const;
     QBlock * blockAt(int px, int py);
     QDomElement xmlNode(QDomDocument & doc) const;
     void setXmlNode(const QDomElement & node);
     void insertXmlTree(int aIndex, const QDomElement & algorithm);
-    bool isActive() const;
+    void insertTree(int aIndex, const QBlock *algorithm); // inserts copies of the blocks of its branch
+    QBlock * clone() const;
+    QByteArray toBinary() const;
+    static QBlock * fromBinary(const QByteArray &aData); // 0 on malformed data
+    void writeTo(QDataStream &stream) const;
+    bool readFrom(QDataStream &stream, int aDepth = 0); // fails on nesting deeper than a few thousand levels
+    bool isActive() const { return fSelected && fFlowChart; }
+    void setSubtreeSelected(bool aValue); // recursive
     double topMargin;
     double bottomMargin;
     double leftMargin;
     double rightMargin;
     static void drawCaption(QPainter *canvas, const QRectF & rect, const double zoomFactor, const QString & text);
+    QString captionText() const;
+    const QBlockCaption & caption() const { return fCaption; }
+    void invalidateCaption() { fCaption.textValid = false; } // after attributes are changed directly
+    int captionWidth(const QFont &font) const;
+    void drawCaptionText(QPainter *canvas, const QRectF &rect, bool wrap) const;
     void makeBackwardCompatibility();
 };
 
 
+/* Clipboard data of copied blocks. The blocks travel in a compact binary
+   encoding; the chart XML for other applications is produced on request. */
+class QFlowChartMimeData : public QMimeData
+{
+  private:
+    QByteArray fBlocks;
+    mutable QString fText;
+
+  protected:
+    QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override;
+
+  public:
+    explicit QFlowChartMimeData(const QBlock *aAlgorithm);
+    QStringList formats() const override;
+    bool hasFormat(const QString &mimeType) const override;
+};
+
+
 class QFlowChart : public QWidget
 {
   Q_OBJECT
@@ -110,6 +236,8 @@ class QFlowChart : public QWidget
     virtual void mousePressEvent(QMouseEvent *pEvent);
     virtual void mouseMoveEvent(QMouseEvent *pEvent);
     virtual void mouseDoubleClickEvent(QMouseEvent * event);
+    virtual void moveEvent(QMoveEvent *event);
+    virtual void changeEvent(QEvent *event);
 
   private:
     QBlock *fRoot;
@@ -117,13 +245,50 @@ class QFlowChart : public QWidget
     double fZoom;
     int fStatus;
     virtual QSize sizeHint() const;
-    QList<QInsertionPoint> insertionPoints;
+    QVector<QInsertionPoint> insertionPoints; // refreshed by every layout pass
+    mutable QVector<int> fPointsByY; // indexes of insertionPoints sorted by y, built on demand
+    mutable bool fPointIndexValid;
+    void buildPointIndex() const;
     QInsertionPoint fTargetPoint;
-    QString fBuffer;
+    QBlock *fBuffer; // detached algorithm to insert, or 0
     bool fMultiInsert;
     QFlowChartStyle fStyle;
     QStack<QString> undoStack;
     QStack<QString> redoStack;
+    bool fPerfOverlay;
+    double fLastPaintTime;
+    double fLastLayoutTime;
+    double fCodegenTime;
+    int fPaintedBlocks;
+    int fBlockCount;
+    QHash<quint64, QPixmap> fContentTiles; // cached content by row and column, see paintContentTiles()
+    QVector<const QBlock *> fLayoutBlocks; // the blocks of the last layout pass in pre-order
+    QVector<QRectF> fLayoutRects; // and their geometry, to find what a layout pass moved
+    bool fPaintingContent;
+    QRect fActiveRect;
+    QFlowChartRenderContext fRenderContext;
+    bool fRenderContextValid;
+    bool fScreenPainting;
+    bool fInteracting;
+    bool fFastFrame; // a frame was painted in the reduced quality
+    QSet<quint64> fFastTiles; // the content tiles rendered in the reduced quality
+    QTimer fInteractionTimer;
+    bool fCanPaste; // the clipboard holds a chart, updated when the clipboard changes
+    QPointer<QFlowChartPerfOverlay> fPerfOverlayWidget;
+    mutable QFlowChartMemoryUsage fMemoryUsage; // computed on demand, the overlay asks for it on every frame
+    mutable bool fMemoryUsageValid;
+    void invalidateMemoryUsage() const { fMemoryUsageValid = false; }
+    void paintContentTiles(QPainter *canvas, const QRect &aRect);
+    void invalidateContent();
+    void invalidateContent(const QRect &aRect); // drops the tiles that intersect aRect
+    void invalidateMovedContent(); // drops the tiles where the last layout pass moved blocks
+    QRect contentRect(const QBlock *aBlock) const; // the block with its shadow
+    void paintContent(QPainter *canvas);
+    void paintOverlay(QPainter *canvas);
+    void setActiveBlock(QBlock *aBlock);
+    void layoutChanged();
+    QRect markerRect(const QInsertionPoint &aPoint) const;
+    static QRect blockRect(const QBlock *aBlock);
 
   public:
 
@@ -138,6 +303,7 @@ class QFlowChart : public QWidget
 
 
     QBlock * root() const;
+    void setRoot(QBlock *aRoot, const double aLayoutZoom); // takes a detached tree already laid out at aLayoutZoom
     QBlock * activeBlock() const;
     double zoom() const;
     int status() const { return fStatus; }
@@ -146,7 +312,10 @@ class QFlowChart : public QWidget
     void regeneratePoints();
     void generatePoints(QBlock *aBlock); // recursive
     static double calcLength(const QPointF & p1, const QPointF & p2);
-    QString buffer() const { return fBuffer; }
+    const QBlock * buffer() const { return fBuffer; }
+    bool hasBuffer() const { return fBuffer != 0; }
+    void setBufferTree(QBlock *aAlgorithm); // takes ownership
+    void setBufferData(const QMimeData *aData);
     bool multiInsert() const { return fMultiInsert; }
     QFlowChartStyle chartStyle() const { return fStyle; }
     void setChartStyle(const QFlowChartStyle & aStyle);
@@ -156,10 +325,18 @@ class QFlowChart : public QWidget
     void fromString(const QString & str);
     bool canUndo() const;
     bool canRedo() const;
-    bool canPaste() const;
+    bool canPaste() const { return fCanPaste; }
     void makeChanged();
+    void blockChanged(QBlock *aBlock); // the attributes of aBlock were edited
     void makeUndo();
     void makeBackwardCompatibility();
+    bool perfOverlay() const { return fPerfOverlay; }
+    QStringList perfOverlayLines() const;
+    int blockCount() const { return fBlockCount; }
+    QFlowChartMemoryUsage memoryUsage() const;
+    void countPaintedBlock() { ++fPaintedBlocks; }
+    bool isPaintingContent() const { return fPaintingContent; }
+    const QFlowChartRenderContext & renderContext(QPaintDevice *device, bool fontSizeInPoints = false);
 
 signals:
     void zoomChanged(const double aZoom);
@@ -167,6 +344,12 @@ signals:
     void editBlock(QBlock *block);
     void changed();
     void modified();
+    void canPasteChanged(bool aValue);
+    /* fine-grained edits for observers such as the autosave journal */
+    void blocksInserted(QBlock *aBranch, int aIndex, const QBlock *aAlgorithm);
+    void blockAboutToBeDeleted(QBlock *aBlock);
+    void attributesEdited(QBlock *aBlock);
+    void documentReplaced(); // the whole tree was replaced or reset
 
   public slots:
     void clear();
@@ -180,8 +363,30 @@ signals:
     void setMultiInsert(bool aValue) { fMultiInsert = aValue; }
     void undo();
     void redo();
+    void setPerfOverlay(bool aValue);
+    void setCodegenTime(double aMilliseconds);
+    void beginInteraction();
 
+  private slots:
+    void endInteraction();
+    void updateCanPaste();
 
 };
 
+/* The performance overlay of a chart. It is a sibling of the chart in the
+   viewport of the scroll area, so it stays in the corner while the chart
+   scrolls under it, and repainting it does not repaint the chart. */
+class QFlowChartPerfOverlay : public QWidget
+{
+  private:
+    const QFlowChart *fChart;
+
+  protected:
+    virtual void paintEvent(QPaintEvent *pEvent);
+
+  public:
+    QFlowChartPerfOverlay(const QFlowChart *aChart, QWidget *aParent);
+    void refresh(); // fits the overlay to the current figures and repaints it
+};
+
 #endif // QFlowChart_H
@@ -14,9 +14,77 @@
 ****************************************************************************/
 
 #include "zvflowchart.h"
+#include "tracer.h"
 #include <QApplication>
 
 namespace {
+/* levels of blocks and branches accepted by QBlock::readFrom(); a loop
+   nested in a loop takes two */
+const int maxBinaryDepth = 4096;
+
+/* Memory is estimated from public sizes and capacities only. What Qt keeps
+   behind a private pointer is counted with these rough 64-bit figures:
+   allocationBytes for the header of a separately allocated string, list or
+   hash, including the allocator's bookkeeping, and objectBytes for the
+   private data of a QObject. A prepared caption is counted with the private
+   data of its fonts and of its QStaticText, objectBytes each, and glyphBytes
+   for the index and the position of every glyph it laid out. The render
+   context is counted with objectBytes for its font, pens and brushes. */
+const qint64 allocationBytes = 32;
+const qint64 objectBytes = 128;
+const qint64 glyphBytes = 16;
+
+qint64 stringBytes(const QString &str)
+{
+  if (str.isNull()) return 0;
+  return allocationBytes + (str.capacity() + 1) * sizeof(QChar);
+}
+
+qint64 stackBytes(const QStack<QString> &stack)
+{
+  qint64 result = allocationBytes + stack.capacity() * sizeof(QString);
+  for (int i = 0; i < stack.size(); ++i)
+  {
+    result += stringBytes(stack.at(i));
+  }
+  return result;
+}
+
+void accountCaption(const QBlockCaption &caption, QFlowChartMemoryUsage &usage)
+{
+  usage.captionBytes += stringBytes(caption.text);
+  if (caption.measuredWidth >= 0)
+    usage.captionBytes += objectBytes;
+  if (caption.prepared)
+    usage.captionBytes += 2 * objectBytes + caption.text.size() * glyphBytes;
+}
+
+qint64 renderContextBytes(const QFlowChartRenderContext &rc)
+{
+  qint64 result = sizeof(QFlowChartRenderContext) + 6 * objectBytes;
+  result += stringBytes(rc.beginText) + stringBytes(rc.endText) + stringBytes(rc.yesText) + stringBytes(rc.noText);
+  return result;
+}
+
+void accountBlock(const QBlock *block, QFlowChartMemoryUsage &usage)
+{
+  usage.blocks++;
+  usage.blockBytes += sizeof(QBlock) + objectBytes;
+  usage.blockBytes += allocationBytes + block->items.size() * sizeof(QBlock *);
+  /* a hash has a bucket array of pointers and a node per entry */
+  usage.attributeBytes += allocationBytes + block->attributes.capacity() * sizeof(void *);
+  for (QHash<QString, QString>::const_iterator it = block->attributes.constBegin(); it != block->attributes.constEnd(); ++it)
+  {
+    usage.attributeBytes += 2 * sizeof(void *) + 2 * sizeof(QString);
+    usage.attributeBytes += stringBytes(it.key()) + stringBytes(it.value());
+  }
+  accountCaption(block->caption(), usage);
+  for (int i = 0; i < block->items.size(); ++i)
+  {
+    accountBlock(block->item(i), usage);
+  }
+}
+
 void initBlockDefaults(QBlock *block)
 {
   block->parent = 0;
@@ -37,9 +105,29 @@ void initBlockDefaults(QBlock *block)
 
 QFlowChart::QFlowChart(QWidget *pObj /* = 0 */) : QWidget(pObj), fZoom(1)
 {
-  fBuffer = QString();
+  fBuffer = 0;
   fTargetPoint = QInsertionPoint();
   fStatus = Display;
+  fPerfOverlay = false;
+  fLastPaintTime = 0;
+  fLastLayoutTime = 0;
+  fCodegenTime = 0;
+  fPaintedBlocks = 0;
+  fBlockCount = 0;
+  fPaintingContent = false;
+  fActiveBlock = 0;
+  fPointIndexValid = false;
+  fMemoryUsageValid = false;
+  fRenderContextValid = false;
+  fScreenPainting = false;
+  fInteracting = false;
+  fFastFrame = false;
+  fInteractionTimer.setSingleShot(true);
+  fInteractionTimer.setInterval(200);
+  connect(&fInteractionTimer, SIGNAL(timeout()), this, SLOT(endInteraction()));
+  fCanPaste = false;
+  connect(QApplication::clipboard(), SIGNAL(dataChanged()), this, SLOT(updateCanPaste()));
+  updateCanPaste();
   fRoot = new QBlock();
   root()->setFlowChart(this);
   clear();
@@ -48,14 +136,21 @@ QFlowChart::QFlowChart(QWidget *pObj /* = 0 */) : QWidget(pObj), fZoom(1)
 
 QFlowChart::~QFlowChart()
 {
-  clear();
+  fActiveBlock = 0;
+  delete fRoot;
+  fRoot = 0;
+  delete fBuffer;
+  /* the overlay belongs to the viewport but reads from the chart */
+  delete fPerfOverlayWidget;
 }
 
 void QFlowChart::makeUndo()
 {
+  AFC_TRACE("QFlowChart::makeUndo");
   QString state = toString();
   undoStack.push(state);
   redoStack.clear();
+  invalidateMemoryUsage();
   emit modified();
 }
 bool QFlowChart::canUndo() const
@@ -68,12 +163,33 @@ bool QFlowChart::canRedo() const
   return !redoStack.isEmpty();
 }
 
-bool QFlowChart::canPaste() const
+void QFlowChart::updateCanPaste()
 {
-  QDomDocument doc;
-  QClipboard *clp = QApplication::clipboard();
-  QString aBuffer = clp->text();
-  return doc.setContent(aBuffer, false);
+  AFC_TRACE("QFlowChart::updateCanPaste");
+  /* the verdict is kept until the clipboard changes again; anything that
+     does not look like a chart is rejected before the full parse */
+  const QMimeData *mime = QApplication::clipboard()->mimeData();
+  bool result = false;
+  if (mime && mime->hasFormat(AFC_BLOCKS_MIME_TYPE))
+  {
+    result = true;
+  }
+  else if (mime)
+  {
+    QString text = mime->text();
+    int start = 0;
+    while (start < text.size() && text.at(start).isSpace()) ++start;
+    if (start < text.size() && text.at(start) == '<' && text.contains("<algorithm"))
+    {
+      QDomDocument doc;
+      result = doc.setContent(text, false);
+    }
+  }
+  if (result != fCanPaste)
+  {
+    fCanPaste = result;
+    emit canPasteChanged(result);
+  }
 }
 
 void QFlowChart::makeChanged()
@@ -81,6 +197,18 @@ void QFlowChart::makeChanged()
   emit changed();
 }
 
+void QFlowChart::blockChanged(QBlock *aBlock)
+{
+  /* the layout pass finds moved blocks, a caption that changed in place
+     is repainted here */
+  aBlock->invalidateCaption();
+  QRect rect = contentRect(aBlock);
+  invalidateContent(rect);
+  update(rect);
+  emit attributesEdited(aBlock);
+  emit changed();
+}
+
 void QFlowChart::undo()
 {
   if (!undoStack.isEmpty())
@@ -88,6 +216,7 @@ void QFlowChart::undo()
     QString state = toString();
     redoStack.push(state);
     state = undoStack.pop();
+    invalidateMemoryUsage();
     fromString(state);
     deselectAll();
     emit changed();
@@ -102,12 +231,58 @@ void QFlowChart::redo()
     QString state = toString();
     undoStack.push(state);
     state = redoStack.pop();
+    invalidateMemoryUsage();
     fromString(state);
     deselectAll();
     emit changed();
   }
 }
 
+QFlowChartMemoryUsage QFlowChart::memoryUsage() const
+{
+  if (fMemoryUsageValid) return fMemoryUsage;
+  QFlowChartMemoryUsage &usage = fMemoryUsage;
+  usage = QFlowChartMemoryUsage();
+  if (root())
+  {
+    accountBlock(root(), usage);
+  }
+  usage.undoBytes = stackBytes(undoStack);
+  usage.redoBytes = stackBytes(redoStack);
+  if (fBuffer)
+  {
+    QFlowChartMemoryUsage buffer;
+    accountBlock(fBuffer, buffer);
+    usage.bufferBytes = buffer.blockBytes + buffer.attributeBytes + buffer.captionBytes;
+  }
+  usage.cacheBytes = insertionPoints.capacity() * sizeof(QInsertionPoint);
+  usage.cacheBytes += fPointsByY.capacity() * sizeof(int);
+  usage.cacheBytes += fLayoutBlocks.capacity() * sizeof(const QBlock *) + fLayoutRects.capacity() * sizeof(QRectF);
+  if (fRenderContextValid)
+    usage.cacheBytes += renderContextBytes(fRenderContext);
+  for (QHash<quint64, QPixmap>::const_iterator it = fContentTiles.constBegin(); it != fContentTiles.constEnd(); ++it)
+  {
+    usage.cacheBytes += qint64(it.value().width()) * it.value().height() * it.value().depth() / 8;
+  }
+  fMemoryUsageValid = true;
+  return usage;
+}
+
+QString QFlowChartMemoryUsage::toString() const
+{
+  QStringList lines;
+  lines << tr("blocks: %1").arg(blocks);
+  lines << tr("block nodes: %1 KB").arg(blockBytes / 1024.0, 0, 'f', 1);
+  lines << tr("attributes: %1 KB").arg(attributeBytes / 1024.0, 0, 'f', 1);
+  lines << tr("captions: %1 KB").arg(captionBytes / 1024.0, 0, 'f', 1);
+  lines << tr("undo history: %1 KB").arg(undoBytes / 1024.0, 0, 'f', 1);
+  lines << tr("redo history: %1 KB").arg(redoBytes / 1024.0, 0, 'f', 1);
+  lines << tr("clipboard buffer: %1 KB").arg(bufferBytes / 1024.0, 0, 'f', 1);
+  lines << tr("caches: %1 KB").arg(cacheBytes / 1024.0, 0, 'f', 1);
+  lines << tr("total: %1 KB").arg(total() / 1024.0, 0, 'f', 1);
+  return lines.join("\n");
+}
+
 QDomDocument QFlowChart::document() const
 {
   QDomDocument doc("AFC");
@@ -128,14 +303,37 @@ QBlock * QFlowChart::activeBlock() const
 
 void QFlowChart::setBuffer(const QString & aBuffer)
 {
+  /* parsed once here, every insertion copies the tree */
   QDomDocument doc;
+  QBlock *algorithm = 0;
   if(doc.setContent(aBuffer, false))
   {
-    fBuffer = aBuffer;
+    QDomElement node = doc.firstChildElement("algorithm");
+    if (!node.isNull())
+    {
+      algorithm = new QBlock();
+      algorithm->setXmlNode(node);
+    }
+  }
+  setBufferTree(algorithm);
+}
+
+void QFlowChart::setBufferTree(QBlock *aAlgorithm)
+{
+  delete fBuffer;
+  fBuffer = aAlgorithm;
+  invalidateMemoryUsage();
+}
+
+void QFlowChart::setBufferData(const QMimeData *aData)
+{
+  if (aData && aData->hasFormat(AFC_BLOCKS_MIME_TYPE))
+  {
+    setBufferTree(QBlock::fromBinary(aData->data(AFC_BLOCKS_MIME_TYPE)));
   }
   else
   {
-    fBuffer = QString();
+    setBuffer(aData ? aData->text() : QString());
   }
 }
 
@@ -152,11 +350,15 @@ QString QFlowChart::toString()
 
 void QFlowChart::fromString(const QString & str)
 {
+  AFC_TRACE("QFlowChart::fromString");
   QDomDocument doc;
   if(doc.setContent(str, false))
   {
+    deselectAll();
+    invalidateContent();
     root()->setXmlNode(doc.firstChildElement("algorithm"));
     realignObjects();
+    emit documentReplaced();
     emit changed();
   }
 }
@@ -165,12 +367,12 @@ void QFlowChart::fromString(const QString & str)
 /******************************** QBlock ***********************************/
 
 
-QBlock::QBlock()
+QBlock::QBlock() : fFlowChart(0), fSelected(false), fIndex(-1)
 {
   initBlockDefaults(this);
 }
 
-QBlock::QBlock(const QString &aType)
+QBlock::QBlock(const QString &aType) : fFlowChart(0), fSelected(false), fIndex(-1)
 {
   initBlockDefaults(this);
   setType(aType);
@@ -180,12 +382,17 @@ QBlock::~QBlock()
 {
   if(parent != 0)
   {
-    parent->remove(this);
-    clear();
+    /* the subtree goes away, so only the parent's list needs fixing */
+    int from = fIndex;
+    parent->items.removeAt(from);
+    parent->renumber(from);
+    parent = 0;
   }
+  deleteItems();
 }
 
 void QBlock::makeBackwardCompatibility() {
+    invalidateCaption();
 
     // it supports obsoletted attributes t1, t2, ..., t8
     // and converts to attribute vars with comma delemited values
@@ -213,16 +420,25 @@ void QBlock::makeBackwardCompatibility() {
     }
 }
 
-void QBlock::clear()
+void QBlock::deleteItems()
 {
-  while(!items.isEmpty())
+  /* children are detached before deletion, so they do not remove
+     themselves one by one and the whole subtree is freed in linear time */
+  for (int i = 0; i < items.size(); ++i)
   {
-    deleteObject(0);
+    QBlock *child = item(i);
+    child->parent = 0;
+    delete child;
   }
+  items.clear();
+}
+
+void QBlock::clear()
+{
+  deleteItems();
   QString currentType = type();
   attributes.clear();
   setType(currentType);
-  items.clear();
 }
 
 QDomElement QBlock::xmlNode(QDomDocument & doc) const
@@ -268,7 +484,6 @@ void QBlock::setXmlNode(const QDomElement & node)
     {
       QDomElement child = children.at(i).toElement();
       QBlock *block = new QBlock();
-      block->setFlowChart(flowChart());
       block->setXmlNode(child);
       append(block);
     }
@@ -283,19 +498,152 @@ void QBlock::insertXmlTree(int aIndex, const QDomElement & algorithm)
     if(!branch.isNull())
     {
       QDomNodeList children = branch.childNodes();
-      int ind = aIndex;
+      QList<QBlock *> blocks;
       for(int i = 0; i < children.size(); ++i)
       {
         if (children.at(i).isElement())
         {
           QDomElement child = children.at(i).toElement();
           QBlock *block = new QBlock();
-          block->setFlowChart(flowChart());
           block->setXmlNode(child);
-          insert(ind, block);
-          ind++;
+          blocks << block;
+        }
+      }
+      insertDetached(aIndex, blocks);
+    }
+  }
+}
+
+void QBlock::insertTree(int aIndex, const QBlock *algorithm)
+{
+  if (isBranch)
+  {
+    for (int i = 0; i < algorithm->items.size(); ++i)
+    {
+      const QBlock *branch = algorithm->item(i);
+      if (branch->type() == "branch")
+      {
+        QList<QBlock *> blocks;
+        blocks.reserve(branch->items.size());
+        for (int j = 0; j < branch->items.size(); ++j)
+        {
+          blocks << branch->item(j)->clone();
         }
+        insertDetached(aIndex, blocks);
+        break;
+      }
+    }
+  }
+}
+
+QBlock * QBlock::clone() const
+{
+  QBlock *result = new QBlock();
+  result->attributes = attributes;
+  result->isBranch = isBranch;
+  for (int i = 0; i < items.size(); ++i)
+  {
+    result->append(item(i)->clone());
+  }
+  return result;
+}
+
+void QBlock::writeTo(QDataStream &stream) const
+{
+  stream << attributes << quint32(items.size());
+  for (int i = 0; i < items.size(); ++i)
+  {
+    item(i)->writeTo(stream);
+  }
+}
+
+bool QBlock::readFrom(QDataStream &stream, int aDepth)
+{
+  /* the data may come from the clipboard of any application, so the
+     nesting is limited before it can exhaust the stack */
+  if (aDepth > maxBinaryDepth) return false;
+  quint32 count = 0;
+  stream >> attributes >> count;
+  invalidateCaption();
+  isBranch = type() == "branch";
+  /* every block takes at least eight bytes, a larger count is garbage */
+  if (stream.status() != QDataStream::Ok || count > stream.device()->bytesAvailable() / 8) return false;
+  for (quint32 i = 0; i < count; ++i)
+  {
+    QBlock *block = new QBlock();
+    append(block);
+    if (!block->readFrom(stream, aDepth + 1)) return false;
+  }
+  return true;
+}
+
+QByteArray QBlock::toBinary() const
+{
+  QByteArray result;
+  QDataStream stream(&result, QIODevice::WriteOnly);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << quint32(0x41464342) << quint16(1); // "AFCB", format version
+  writeTo(stream);
+  return result;
+}
+
+QBlock * QBlock::fromBinary(const QByteArray &aData)
+{
+  QDataStream stream(aData);
+  stream.setVersion(QDataStream::Qt_5_0);
+  quint32 magic = 0;
+  quint16 version = 0;
+  stream >> magic >> version;
+  if (magic != 0x41464342 || version != 1) return 0;
+  QBlock *result = new QBlock();
+  if (!result->readFrom(stream) || result->type() != "algorithm")
+  {
+    delete result;
+    return 0;
+  }
+  return result;
+}
+
+
+/*************************** QFlowChartMimeData ****************************/
+
+
+QFlowChartMimeData::QFlowChartMimeData(const QBlock *aAlgorithm)
+  : fBlocks(aAlgorithm->toBinary())
+{
+}
+
+QStringList QFlowChartMimeData::formats() const
+{
+  return QStringList() << AFC_BLOCKS_MIME_TYPE << "text/plain";
+}
+
+bool QFlowChartMimeData::hasFormat(const QString &mimeType) const
+{
+  return formats().contains(mimeType);
+}
+
+QVariant QFlowChartMimeData::retrieveData(const QString &mimeType, QVariant::Type type) const
+{
+  if (mimeType == AFC_BLOCKS_MIME_TYPE)
+  {
+    return fBlocks;
+  }
+  if (mimeType == "text/plain")
+  {
+    if (fText.isNull())
+    {
+      AFC_TRACE("QFlowChartMimeData::text");
+      QBlock *algorithm = QBlock::fromBinary(fBlocks);
+      if (algorithm)
+      {
+        QDomDocument doc("AFC"); // do not localize!
+        doc.appendChild(algorithm->xmlNode(doc));
+        fText = doc.toString(2);
+        delete algorithm;
       }
     }
+    return fText;
   }
+  return QMimeData::retrieveData(mimeType, type);
 }
@@ -18,6 +18,7 @@
 void QFlowChart::clear()
 {
     deselectAll();
+    invalidateContent();
     root()->clear();
     root()->attributes.clear();
     root()->setType("algorithm");
@@ -26,6 +27,8 @@ void QFlowChart::clear()
     branch->isBranch = true;
     root()->append(branch);
     branch->setFlowChart(root()->flowChart());
+    regeneratePoints();
+    emit documentReplaced();
 
 //    fDocument->clear();
 //    QDomProcessingInstruction xml = fDocument->createProcessingInstruction("xml", "version=\"1.0\" encoding=\"utf-8\" stand-alone=\"yes\"");
@@ -40,32 +43,43 @@ void QFlowChart::clear()
 
 void QFlowChart::selectAll()
 {
-  fActiveBlock = root();
+  setActiveBlock(root());
   emit changed();
-  update();
 }
 
 void QFlowChart::deselectAll()
 {
-    fActiveBlock = 0;
+    setActiveBlock(0);
     emit changed();
-    update();
+}
+
+void QFlowChart::setActiveBlock(QBlock *aBlock)
+{
+  /* only the old and the new selection are repainted, the rest of the
+     chart comes from the content cache */
+  if (!fActiveRect.isNull()) update(fActiveRect);
+  /* the selection flags of the subtree make QBlock::isActive() constant time */
+  if (fActiveBlock) fActiveBlock->setSubtreeSelected(false);
+  fActiveBlock = aBlock;
+  if (fActiveBlock) fActiveBlock->setSubtreeSelected(true);
+  fActiveRect = aBlock ? blockRect(aBlock) : QRect();
+  if (!fActiveRect.isNull()) update(fActiveRect);
 }
 
 void QFlowChart::setStatus(int aStatus)
 {
   fStatus = aStatus;
+  invalidateContent();
   if (status() == Insertion)
   {
     setMouseTracking(true);
-    regeneratePoints();
-    update();
   }
   else
   {
     fTargetPoint = QInsertionPoint();
     setMouseTracking(false);
   }
+  update();
   emit statusChanged();
   emit changed();
 }
@@ -76,7 +90,7 @@ void QFlowChart::deleteActiveBlock()
   {
     makeUndo();
     QBlock *tmp = activeBlock();
-    fActiveBlock = 0;
+    setActiveBlock(0);
     deleteBlock(tmp);
     emit changed();
   }
@@ -93,25 +107,24 @@ void QFlowChart::mousePressEvent(QMouseEvent *pEvent)
       {
         if(activeBlock()->parent)
         {
-          fActiveBlock = activeBlock()->parent;
+          setActiveBlock(activeBlock()->parent);
         }
         else
         {
-          fActiveBlock = block;
+          setActiveBlock(block);
         }
       }
       else
       {
         if(block->parent !=0 && block->isBranch)
         {
-          fActiveBlock = block->parent;
+          setActiveBlock(block->parent);
         }
         else
-          fActiveBlock = block;
+          setActiveBlock(block);
 
       }
       emit changed();
-      update();
     }
   }
   else if(status() == Insertion)
@@ -119,22 +132,17 @@ void QFlowChart::mousePressEvent(QMouseEvent *pEvent)
     QPoint mp = pEvent->pos();
     QInsertionPoint ip = getNearistPoint(mp.x(), mp.y());
     fTargetPoint = ip;
-    if(!ip.isNull() && !buffer().isEmpty())
+    if(!ip.isNull() && hasBuffer())
     {
-      QDomDocument doc;
-      if(doc.setContent(buffer(), false))
+      QBlock *branch = ip.branch();
+      if(branch)
       {
-        QDomElement algorithm = doc.firstChildElement("algorithm");
-        QBlock *branch = ip.branch();
-        if(branch)
-        {
-          makeUndo();
-          branch->insertXmlTree(ip.index(), algorithm);
-          realignObjects();
-          regeneratePoints();
-          fActiveBlock = 0;
-          emit changed();
-        }
+        makeUndo();
+        branch->insertTree(ip.index(), buffer());
+        emit blocksInserted(branch, ip.index(), buffer());
+        realignObjects();
+        setActiveBlock(0);
+        emit changed();
       }
     }
     if (!multiInsert()) setStatus(Selectable);
@@ -160,13 +168,19 @@ void QFlowChart::mouseMoveEvent(QMouseEvent *pEvent)
   {
     QPoint mp = pEvent->pos();
     QInsertionPoint ip = getNearistPoint(mp.x(), mp.y());
-    fTargetPoint = ip;
-    repaint();
+    if (ip.branch() != fTargetPoint.branch() || ip.index() != fTargetPoint.index() || ip.point() != fTargetPoint.point())
+    {
+      /* only the pixels around the old and the new marker change */
+      update(markerRect(fTargetPoint));
+      fTargetPoint = ip;
+      update(markerRect(fTargetPoint));
+    }
   }
 }
 
 void QFlowChart::deleteBlock(QBlock *aBlock)
 {
+  emit blockAboutToBeDeleted(aBlock);
   if (aBlock == root())
   {
     for(int i = 0; i < aBlock->items.size(); ++i)
@@ -194,21 +208,25 @@ void QFlowChart::deleteBlock(QBlock *aBlock)
 
 QBlock * QBlock::root()
 {
-  if (parent == 0)
+  /* blocks of a document know it, only detached trees are walked */
+  if (flowChart())
   {
-    return this;
+    return flowChart()->root();
   }
-  else
+  QBlock *result = this;
+  while (result->parent)
   {
-    return parent->root();
+    result = result->parent;
   }
+  return result;
 }
 
-int QBlock::index()
+void QBlock::renumber(int aFrom)
 {
-
-  if(parent == 0) return -1;
-  else return parent->items.indexOf(this);
+  for (int i = aFrom; i < items.size(); ++i)
+  {
+    item(i)->fIndex = i;
+  }
 }
 
 void QBlock::insert(int newIndex, QBlock *aBlock)
@@ -217,19 +235,52 @@ void QBlock::insert(int newIndex, QBlock *aBlock)
   {
     aBlock->parent->remove(aBlock);
   }
+  aBlock->parent = this;
   if (newIndex < 0 || newIndex >= items.size())
+  {
+    aBlock->fIndex = items.size();
     items.append(aBlock);
+  }
   else
+  {
     items.insert(newIndex, aBlock);
-  aBlock->parent = this;
+    renumber(newIndex);
+  }
   aBlock->setFlowChart(flowChart());
+  if (aBlock->fSelected != fSelected) aBlock->setSubtreeSelected(fSelected);
 }
 
 void QBlock::remove(QBlock *aBlock)
 {
-  items.removeAll(aBlock);
+  Q_ASSERT(aBlock->parent == this && item(aBlock->fIndex) == aBlock);
+  int from = aBlock->fIndex;
+  items.removeAt(from);
+  renumber(from);
   aBlock->parent = 0;
+  aBlock->fIndex = -1;
   aBlock->setFlowChart(0);
+  if (aBlock->fSelected) aBlock->setSubtreeSelected(false);
+}
+
+void QBlock::insertDetached(int aIndex, const QList<QBlock *> &aBlocks)
+{
+  /* the blocks are spliced in at once and the items after them renumbered
+     once, so a paste of many blocks into a long branch stays linear */
+  if (aIndex < 0 || aIndex >= items.size()) aIndex = items.size();
+  QList<QBlock *> result;
+  result.reserve(items.size() + aBlocks.size());
+  result += items.mid(0, aIndex);
+  result += aBlocks;
+  result += items.mid(aIndex);
+  items = result;
+  for (int i = 0; i < aBlocks.size(); ++i)
+  {
+    QBlock *block = aBlocks.at(i);
+    block->parent = this;
+    block->setFlowChart(flowChart());
+    if (block->fSelected != fSelected) block->setSubtreeSelected(fSelected);
+  }
+  renumber(aIndex);
 }
 
 void QBlock::append(QBlock *aBlock)
@@ -257,13 +308,26 @@ void QBlock::setItem(int aIndex, QBlock *aBlock)
     }
     QBlock *old = item(aIndex);
     old->parent = 0;
+    old->fIndex = -1;
+    old->setFlowChart(0);
+    if (old->fSelected) old->setSubtreeSelected(false);
     items.replace(aIndex, aBlock);
+    aBlock->parent = this;
+    aBlock->fIndex = aIndex;
+    aBlock->setFlowChart(flowChart());
+    if (aBlock->fSelected != fSelected) aBlock->setSubtreeSelected(fSelected);
   }
 }
 
 void QBlock::setFlowChart(QFlowChart * aFlowChart)
 {
+  /* a subtree always belongs to a single document, or to none */
+  if (fFlowChart == aFlowChart) return;
   fFlowChart = aFlowChart;
+  for (int i = 0; i < items.size(); ++i)
+  {
+    item(i)->setFlowChart(aFlowChart);
+  }
 }
 
 QBlock * QBlock::blockAt(int px, int py)
@@ -281,21 +345,11 @@ QBlock * QBlock::blockAt(int px, int py)
   }
 }
 
-bool QBlock::isActive() const
+void QBlock::setSubtreeSelected(bool aValue)
 {
-  if(flowChart())
+  fSelected = aValue;
+  for (int i = 0; i < items.size(); ++i)
   {
-    if (flowChart()->activeBlock() == this) return true;
-    else if (parent)
-    {
-      return parent->isActive();
-    }
-    else
-    {
-      return false;
-    }
-
+    item(i)->setSubtreeSelected(aValue);
   }
-  else
-    return false;
 }
@@ -14,6 +14,9 @@
 ****************************************************************************/
 
 #include "zvflowchart.h"
+#include "tracer.h"
+
+#include <algorithm>
 
 namespace {
 QFont blockFont(double zoom)
@@ -23,42 +26,120 @@ QFont blockFont(double zoom)
   return font;
 }
 
-double textWidthWithPadding(const QString &text, double zoom, double padding)
+int countBlocks(const QBlock *block)
 {
-  QFontMetrics fm(blockFont(zoom));
-  return fm.horizontalAdvance(text) + padding;
+  int result = 1;
+  for (int i = 0; i < block->items.size(); ++i)
+  {
+    result += countBlocks(block->item(i));
+  }
+  return result;
 }
 
-QString normalizedVars(const QString &vars)
+void collectGeometry(const QBlock *block, QVector<const QBlock *> &blocks, QVector<QRectF> &rects)
 {
-  QStringList list = vars.split(",");
-  return list.join(", ");
+  blocks.append(block);
+  rects.append(QRectF(block->x, block->y, block->width, block->height));
+  for (int i = 0; i < block->items.size(); ++i)
+  {
+    collectGeometry(block->item(i), blocks, rects);
+  }
 }
+
 }
 
 void QFlowChart::setZoom(const double aZoom)
 {
   fZoom = aZoom;
+  fTargetPoint = QInsertionPoint();
   realignObjects();
-  if (status() == Insertion)
-  {
-    fTargetPoint = QInsertionPoint();
-    regeneratePoints();
-  }
   emit zoomChanged(aZoom);
 }
 
 void QFlowChart::realignObjects()
 {
+  AFC_TRACE("QFlowChart::realignObjects");
   if(root())
   {
+    QElapsedTimer timer;
+    timer.start();
     makeBackwardCompatibility();
-    root()->adjustSize(zoom());
+    {
+      AFC_TRACE("QBlock::adjustSize");
+      root()->adjustSize(zoom());
+    }
     root()->adjustPosition(0,0);
-    resize(root()->width, root()->height);
-    emit changed();
-    update();
+    regeneratePoints();
+    invalidateMovedContent();
+    fBlockCount = countBlocks(root());
+    fLastLayoutTime = timer.nsecsElapsed() / 1000000.0;
+    layoutChanged();
+  }
+}
+
+void QFlowChart::invalidateMovedContent()
+{
+  QVector<const QBlock *> blocks;
+  QVector<QRectF> rects;
+  blocks.reserve(fLayoutBlocks.size());
+  rects.reserve(fLayoutRects.size());
+  collectGeometry(root(), blocks, rects);
+  if (blocks != fLayoutBlocks)
+  {
+    /* blocks were inserted or removed */
+    invalidateContent();
   }
+  else
+  {
+    QRectF moved;
+    for (int i = 0; i < rects.size(); ++i)
+    {
+      if (rects.at(i) != fLayoutRects.at(i))
+      {
+        moved |= fLayoutRects.at(i) | rects.at(i);
+      }
+    }
+    if (!moved.isNull())
+    {
+      int margin = qCeil(8 * zoom()) + 1;
+      invalidateContent(moved.toAlignedRect().adjusted(-margin, -margin, margin, margin));
+    }
+  }
+  fLayoutBlocks.swap(blocks);
+  fLayoutRects.swap(rects);
+}
+
+QRect QFlowChart::contentRect(const QBlock *aBlock) const
+{
+  int margin = qCeil(8 * zoom());
+  return blockRect(aBlock).adjusted(-margin, -margin, margin, margin);
+}
+
+void QFlowChart::layoutChanged()
+{
+  fActiveRect = activeBlock() ? blockRect(activeBlock()) : QRect();
+  resize(root()->width, root()->height);
+  invalidateMemoryUsage();
+  emit changed();
+  update();
+}
+
+void QFlowChart::setRoot(QBlock *aRoot, const double aLayoutZoom)
+{
+  AFC_TRACE("QFlowChart::setRoot");
+  deselectAll();
+  fTargetPoint = QInsertionPoint();
+  delete fRoot;
+  fRoot = aRoot;
+  root()->setFlowChart(this);
+  fZoom = aLayoutZoom;
+  regeneratePoints();
+  invalidateContent();
+  invalidateMovedContent();
+  fBlockCount = countBlocks(root());
+  layoutChanged();
+  emit documentReplaced();
+  emit zoomChanged(aLayoutZoom);
 }
 
 QSize QFlowChart::sizeHint() const
@@ -71,30 +152,66 @@ QSize QFlowChart::sizeHint() const
 
 }
 
+void QFlowChart::buildPointIndex() const
+{
+  fPointsByY.resize(insertionPoints.size());
+  for (int i = 0; i < fPointsByY.size(); ++i)
+  {
+    fPointsByY[i] = i;
+  }
+  const QVector<QInsertionPoint> &points = insertionPoints;
+  std::sort(fPointsByY.begin(), fPointsByY.end(), [&points](int a, int b) {
+    double ya = points.at(a).point().y();
+    double yb = points.at(b).point().y();
+    return ya < yb || (ya == yb && a < b);
+  });
+  fPointIndexValid = true;
+  invalidateMemoryUsage();
+}
+
 QInsertionPoint QFlowChart::getNearistPoint(int x, int y) const
 {
-  QInsertionPoint result;
-  if (insertionPoints.size() > 0)
+  if (insertionPoints.isEmpty()) return QInsertionPoint();
+  if (!fPointIndexValid) buildPointIndex();
+
+  /* walk up and down from the mouse row in y order; a side is finished as
+     soon as its vertical distance alone exceeds the best distance found.
+     Equal distances resolve to the earlier point, as a linear scan would. */
+  QPointF target(x, y);
+  int down = std::lower_bound(fPointsByY.constBegin(), fPointsByY.constEnd(), target.y(),
+                              [this](int index, double value) { return insertionPoints.at(index).point().y() < value; })
+             - fPointsByY.constBegin();
+  int up = down - 1;
+  int best = -1;
+  double len = 0;
+  while (up >= 0 || down < fPointsByY.size())
   {
-    result = insertionPoints.at(0);
-    double len = calcLength(result.point(), QPointF(x, y));
-    for (int i = 0; i < insertionPoints.size(); ++i)
+    double dyUp = up >= 0 ? target.y() - insertionPoints.at(fPointsByY.at(up)).point().y() : -1;
+    double dyDown = down < fPointsByY.size() ? insertionPoints.at(fPointsByY.at(down)).point().y() - target.y() : -1;
+    bool takeUp = dyDown < 0 || (dyUp >= 0 && dyUp <= dyDown);
+    int index = takeUp ? fPointsByY.at(up) : fPointsByY.at(down);
+    double dy = takeUp ? dyUp : dyDown;
+    if (best >= 0 && dy * dy > len) break;
+    double tmp = calcLength(insertionPoints.at(index).point(), target);
+    if (best < 0 || tmp < len || (tmp == len && index < best))
     {
-      QInsertionPoint ip = insertionPoints.at(i);
-      double tmp = calcLength(ip.point(), QPointF(x, y));
-      if (tmp < len)
-      {
-        result = ip;
-        len = tmp;
-      }
+      best = index;
+      len = tmp;
     }
+    if (takeUp) --up;
+    else ++down;
   }
-  return result;
+  return insertionPoints.at(best);
 }
 
 void QFlowChart::regeneratePoints()
 {
-  insertionPoints.clear();
+  /* called after every layout pass, so entering the insertion mode finds
+     the points ready; resize(0) keeps the capacity and the array is
+     refilled in place without allocations; the markers only move with
+     the blocks, so the content is invalidated by the layout pass */
+  fPointIndexValid = false;
+  insertionPoints.resize(0);
   if(root())
   {
     generatePoints(root());
@@ -108,22 +225,11 @@ void QFlowChart::generatePoints(QBlock *aBlock)
     double x = aBlock->x + aBlock->width / 2.0;
     for (int i = 0; i < aBlock->items.size(); ++i)
     {
-      double y = aBlock->item(i)->y;
-      QInsertionPoint p;
-      p.setBranch(aBlock);
-      p.setPoint(QPointF(x, y));
-      p.setIndex(i);
-      insertionPoints.append(p);
+      insertionPoints.append(QInsertionPoint(aBlock, i, QPointF(x, aBlock->item(i)->y)));
       generatePoints(aBlock->item(i));
     }
-    QInsertionPoint p;
-    p.setBranch(aBlock);
-    if(aBlock->items.size() == 0)
-      p.setPoint(QPointF(x, aBlock->y + aBlock->height / 2));
-    else
-      p.setPoint(QPointF(x, aBlock->y + aBlock->height));
-    p.setIndex(aBlock->items.size());
-    insertionPoints.append(p);
+    double y = aBlock->items.isEmpty() ? aBlock->y + aBlock->height / 2 : aBlock->y + aBlock->height;
+    insertionPoints.append(QInsertionPoint(aBlock, aBlock->items.size(), QPointF(x, y)));
   }
   else
   {
@@ -142,10 +248,36 @@ double QFlowChart::calcLength(const QPointF & p1, const QPointF & p2)
 void QFlowChart::setChartStyle(const QFlowChartStyle & aStyle)
 {
   fStyle = aStyle;
+  fRenderContextValid = false;
+  invalidateContent();
   emit changed();
   update();
 }
 
+void QFlowChart::setPerfOverlay(bool aValue)
+{
+  fPerfOverlay = aValue;
+  if (aValue)
+  {
+    /* pinned to the viewport of the scroll area, or to the chart itself
+       when it is not scrolled */
+    if (!fPerfOverlayWidget)
+      fPerfOverlayWidget = new QFlowChartPerfOverlay(this, parentWidget() ? parentWidget() : this);
+    fPerfOverlayWidget->refresh();
+    fPerfOverlayWidget->show();
+  }
+  else if (fPerfOverlayWidget)
+  {
+    fPerfOverlayWidget->hide();
+  }
+}
+
+void QFlowChart::setCodegenTime(double aMilliseconds)
+{
+  fCodegenTime = aMilliseconds;
+  if (perfOverlay() && fPerfOverlayWidget) fPerfOverlayWidget->refresh();
+}
+
 double QFlowChart::zoom() const
 {
   return fZoom;
@@ -173,6 +305,42 @@ void QFlowChart::drawRightArrow(QPainter *canvas, const QPointF & aPoint, const
 /******************************** QBlock ***********************************/
 
 
+QString QBlock::captionText() const
+{
+  QString t = type();
+  if (t == "process")
+    return attributes.value("text", "");
+  else if (t == "assign")
+    return QString("%1 := %2").arg(attributes.value("dest", ""), attributes.value("src", ""));
+  else if (t == "io" || t == "ou")
+    return attributes.value("vars", "").split(",").join(", ");
+  else if (t == "if" || t == "pre" || t == "post")
+    return QString("%1?").arg(attributes.value("cond", ""));
+  else if (t == "for")
+    return QString("%1 := %2...%3").arg(attributes.value("var", ""), attributes.value("from", ""), attributes.value("to", ""));
+  return QString();
+}
+
+void QBlock::updateCaptionText() const
+{
+  if (!fCaption.textValid)
+  {
+    fCaption.setText(captionText());
+    fCaption.textValid = true;
+  }
+}
+
+int QBlock::captionWidth(const QFont &font) const
+{
+  updateCaptionText();
+  if (fCaption.measuredWidth < 0 || fCaption.measureFont != font)
+  {
+    fCaption.measureFont = font;
+    fCaption.measuredWidth = QFontMetrics(font).horizontalAdvance(fCaption.text);
+  }
+  return fCaption.measuredWidth;
+}
+
 void QBlock::adjustSize(const double aZoom)
 {
   double clientWidth = 0, clientHeight = 0;
@@ -215,7 +383,7 @@ void QBlock::adjustSize(const double aZoom)
     {
       topMargin = 16 * aZoom;
       bottomMargin = 10 * aZoom;
-      double textWidth = textWidthWithPadding(attributes.value("text", ""), aZoom, 16 * aZoom);
+      double textWidth = captionWidth(blockFont(aZoom)) + 16 * aZoom;
       double minWidth = 120 * aZoom;
       clientWidth = qMax(minWidth, textWidth);
       clientHeight = 60 * aZoom;
@@ -224,8 +392,7 @@ void QBlock::adjustSize(const double aZoom)
     {
       topMargin = 16 * aZoom;
       bottomMargin = 10 * aZoom;
-      QString text = QString("%1 := %2").arg(attributes.value("dest", ""), attributes.value("src", ""));
-      double textWidth = textWidthWithPadding(text, aZoom, 16 * aZoom);
+      double textWidth = captionWidth(blockFont(aZoom)) + 16 * aZoom;
       double minWidth = 120 * aZoom;
       clientWidth = qMax(minWidth, textWidth);
       clientHeight = 60 * aZoom;
@@ -236,8 +403,7 @@ void QBlock::adjustSize(const double aZoom)
       bottomMargin = 10 * aZoom;
       leftMargin = 20 * aZoom;
       rightMargin = 20 * aZoom;
-      QString text = normalizedVars(attributes.value("vars", ""));
-      double textWidth = textWidthWithPadding(text, aZoom, 20 * aZoom);
+      double textWidth = captionWidth(blockFont(aZoom)) + 20 * aZoom;
       double minWidth = 120 * aZoom;
       clientWidth = qMax(minWidth, textWidth);
       clientHeight = 60 * aZoom;
@@ -248,8 +414,7 @@ void QBlock::adjustSize(const double aZoom)
       bottomMargin = 10 * aZoom;
       leftMargin = 20 * aZoom;
       rightMargin = 20 * aZoom;
-      QString text = normalizedVars(attributes.value("vars", ""));
-      double textWidth = textWidthWithPadding(text, aZoom, 20 * aZoom);
+      double textWidth = captionWidth(blockFont(aZoom)) + 20 * aZoom;
       double minWidth = 120 * aZoom;
       clientWidth = qMax(minWidth, textWidth);
       clientHeight = 60 * aZoom;
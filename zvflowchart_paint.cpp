@@ -14,43 +14,355 @@
 ****************************************************************************/
 
 #include "zvflowchart.h"
+#include "tracer.h"
+
+namespace {
+/* the content is cached in square tiles of this many logical pixels, so
+   only the area around the view is kept and an edit re-renders only the
+   tiles it touched */
+const int contentTileSize = 256;
+
+quint64 tileKey(int row, int column)
+{
+    return (quint64(quint32(row)) << 32) | quint32(column);
+}
+
+QRect tileRect(int row, int column)
+{
+    return QRect(column * contentTileSize, row * contentTileSize, contentTileSize, contentTileSize);
+}
+
+/* on screen, captions, shadows and arrow heads are dropped below these
+   zoom factors where they are too small to be read anyway */
+const double textMinZoom = 0.4;
+const double shadowMinZoom = 0.6;
+const double arrowMinZoom = 0.3;
+/* and below this one the symbols themselves give way to plain outlines */
+const double outlineMaxZoom = 0.25;
+}
 
 void QFlowChart::paintEvent(QPaintEvent *pEvent)
 {
     QPainter canvas(this);
     pEvent->accept();
-    canvas.setClipRect(pEvent->rect());
-    canvas.setRenderHint(QPainter::Antialiasing, true);
-    paintTo(&canvas);
+    QRect r = pEvent->rect();
+    canvas.setClipRect(r);
+    canvas.setRenderHint(QPainter::Antialiasing, !fInteracting);
+    QElapsedTimer timer;
+    timer.start();
+    fPaintedBlocks = 0;
+    fScreenPainting = true;
+    if (root())
+    {
+      paintContentTiles(&canvas, r);
+      paintOverlay(&canvas);
+      if (fInteracting) fFastFrame = true;
+    }
+    fScreenPainting = false;
+    fLastPaintTime = timer.nsecsElapsed() / 1000000.0;
+    if (perfOverlay() && fPerfOverlayWidget) fPerfOverlayWidget->refresh();
 }
 
-void QFlowChart::paintTo(QPainter *canvas)
+void QFlowChart::paintContentTiles(QPainter *canvas, const QRect &aRect)
 {
-    if (root())
+    qreal dpr = devicePixelRatioF();
+    int top = qMax(0, aRect.top()) / contentTileSize;
+    int left = qMax(0, aRect.left()) / contentTileSize;
+    int bottom = qMax(0, aRect.bottom()) / contentTileSize;
+    int right = qMax(0, aRect.right()) / contentTileSize;
+
+    /* the missing tiles are rendered together, in one pass over the chart */
+    QRect missing;
+    for (int row = top; row <= bottom; ++row)
     {
-      root()->paint(canvas);
-      if (status() == Insertion)
+      for (int column = left; column <= right; ++column)
       {
-        QFlowChartStyle st = chartStyle();
-        for (int i = 0; i < insertionPoints.size(); ++i)
-        {
-          QInsertionPoint ip = insertionPoints.at(i);
-          QPointF p = ip.point();
-          canvas->setPen(QPen(st.normalForeground(), 2 * zoom()));
-          canvas->setBrush(st.normalForeground());
-          canvas->drawEllipse(p, 3 * zoom(), 3 * zoom());
-        }
-        if (!targetPoint().isNull())
+        QHash<quint64, QPixmap>::const_iterator it = fContentTiles.constFind(tileKey(row, column));
+        if (it == fContentTiles.constEnd() || it.value().devicePixelRatio() != dpr)
+          missing |= tileRect(row, column);
+      }
+    }
+    if (!missing.isEmpty())
+    {
+      QPixmap area(missing.size() * dpr);
+      area.setDevicePixelRatio(dpr);
+      area.fill(Qt::transparent);
+      QPainter painter(&area);
+      painter.setRenderHint(QPainter::Antialiasing, !fInteracting);
+      painter.translate(-missing.topLeft());
+      paintContent(&painter);
+      painter.end();
+      int tilePixels = qRound(contentTileSize * dpr);
+      for (int row = missing.top() / contentTileSize; row <= missing.bottom() / contentTileSize; ++row)
+      {
+        for (int column = missing.left() / contentTileSize; column <= missing.right() / contentTileSize; ++column)
         {
-          QPointF p = targetPoint().point();
-          canvas->setPen(QPen(st.selectedBackground(), 2 * zoom()));
-          canvas->setBrush(st.selectedBackground());
-          canvas->drawEllipse(p, 7 * zoom(), 7 * zoom());
+          QPoint origin = (tileRect(row, column).topLeft() - missing.topLeft()) * dpr;
+          QPixmap tile = area.copy(QRect(origin, QSize(tilePixels, tilePixels)));
+          tile.setDevicePixelRatio(dpr);
+          fContentTiles.insert(tileKey(row, column), tile);
+          if (fInteracting) fFastTiles.insert(tileKey(row, column));
+          else fFastTiles.remove(tileKey(row, column));
         }
       }
+      invalidateMemoryUsage();
+    }
+
+    for (int row = top; row <= bottom; ++row)
+    {
+      for (int column = left; column <= right; ++column)
+      {
+        canvas->drawPixmap(tileRect(row, column).topLeft(), fContentTiles.value(tileKey(row, column)));
+      }
+    }
+
+    /* tiles away from the view are dropped, so the cache stays about the
+       size of the viewport whatever the size of the chart */
+    QRect keep = visibleRegion().boundingRect().adjusted(-contentTileSize, -contentTileSize, contentTileSize, contentTileSize);
+    QHash<quint64, QPixmap>::iterator it = fContentTiles.begin();
+    while (it != fContentTiles.end())
+    {
+      if (keep.intersects(tileRect(int(it.key() >> 32), int(it.key() & 0xffffffff))))
+        ++it;
+      else
+      {
+        fFastTiles.remove(it.key());
+        it = fContentTiles.erase(it);
+        invalidateMemoryUsage();
+      }
+    }
+}
+
+void QFlowChart::invalidateContent()
+{
+    fContentTiles.clear();
+    fFastTiles.clear();
+    invalidateMemoryUsage();
+}
+
+void QFlowChart::invalidateContent(const QRect &aRect)
+{
+    QHash<quint64, QPixmap>::iterator it = fContentTiles.begin();
+    while (it != fContentTiles.end())
+    {
+      if (aRect.intersects(tileRect(int(it.key() >> 32), int(it.key() & 0xffffffff))))
+      {
+        fFastTiles.remove(it.key());
+        it = fContentTiles.erase(it);
+      }
+      else
+        ++it;
+    }
+    invalidateMemoryUsage();
+}
+
+void QFlowChart::moveEvent(QMoveEvent *event)
+{
+    QWidget::moveEvent(event);
+    /* the chart moves inside the scroll area while it is being scrolled */
+    beginInteraction();
+}
+
+void QFlowChart::beginInteraction()
+{
+    fInteracting = true;
+    fInteractionTimer.start();
+}
+
+void QFlowChart::endInteraction()
+{
+    fInteracting = false;
+    /* repaint in full quality what was painted while scrolling or zooming,
+       the tiles rendered before are kept */
+    if (!fFastTiles.isEmpty())
+    {
+      for (QSet<quint64>::const_iterator it = fFastTiles.constBegin(); it != fFastTiles.constEnd(); ++it)
+      {
+        fContentTiles.remove(*it);
+      }
+      fFastTiles.clear();
+      invalidateMemoryUsage();
+    }
+    if (fFastFrame)
+    {
+      fFastFrame = false;
+      update();
+    }
+}
+
+QStringList QFlowChart::perfOverlayLines() const
+{
+    QFlowChartMemoryUsage usage = memoryUsage();
+    QStringList lines;
+    lines << tr("paint: %1 ms").arg(fLastPaintTime, 0, 'f', 2);
+    lines << tr("layout: %1 ms").arg(fLastLayoutTime, 0, 'f', 2);
+    lines << tr("blocks: %1 / %2").arg(fPaintedBlocks).arg(fBlockCount);
+    lines << tr("undo: %1 (%2 KB)").arg(undoStack.size()).arg(usage.undoBytes / 1024);
+    lines << tr("codegen: %1 ms").arg(fCodegenTime, 0, 'f', 2);
+    lines << tr("memory: %1 KB").arg(usage.total() / 1024);
+    return lines;
+}
+
+QFlowChartPerfOverlay::QFlowChartPerfOverlay(const QFlowChart *aChart, QWidget *aParent) : QWidget(aParent), fChart(aChart)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    QFont overlayFont("Courier New");
+    overlayFont.setPixelSize(12);
+    setFont(overlayFont);
+    move(8, 8);
+}
+
+void QFlowChartPerfOverlay::refresh()
+{
+    QStringList lines = fChart->perfOverlayLines();
+    QFontMetrics fm(font());
+    int w = 0;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+      w = qMax(w, fm.horizontalAdvance(lines.at(i)));
+    }
+    QSize needed(w + 16, lines.size() * fm.height() + 12);
+    if (size() != needed) resize(needed);
+    raise();
+    update();
+}
+
+void QFlowChartPerfOverlay::paintEvent(QPaintEvent *pEvent)
+{
+    pEvent->accept();
+    QStringList lines = fChart->perfOverlayLines();
+    QPainter canvas(this);
+    canvas.fillRect(rect(), QColor(64, 64, 64));
+    canvas.setPen(Qt::white);
+    QFontMetrics fm(font());
+    for (int i = 0; i < lines.size(); ++i)
+    {
+      canvas.drawText(8, 6 + fm.ascent() + i * fm.height(), lines.at(i));
+    }
+}
+
+void QFlowChart::paintTo(QPainter *canvas)
+{
+    AFC_TRACE("QFlowChart::paintTo");
+    fPaintedBlocks = 0;
+    if (root())
+    {
+      paintContent(canvas);
+      paintOverlay(canvas);
+    }
+    /* the captions may have been prepared for the device */
+    invalidateMemoryUsage();
+}
+
+void QFlowChart::paintContent(QPainter *canvas)
+{
+    AFC_TRACE("QFlowChart::paintContent");
+    fPaintingContent = true;
+    root()->paint(canvas);
+    fPaintingContent = false;
+    if (status() == Insertion)
+    {
+      QFlowChartStyle st = chartStyle();
+      canvas->setPen(QPen(st.normalForeground(), 2 * zoom()));
+      canvas->setBrush(st.normalForeground());
+      for (int i = 0; i < insertionPoints.size(); ++i)
+      {
+        canvas->drawEllipse(insertionPoints.at(i).point(), 3 * zoom(), 3 * zoom());
+      }
+    }
+}
+
+void QFlowChart::paintOverlay(QPainter *canvas)
+{
+    if (status() == Selectable && activeBlock())
+    {
+      QBlock *block = activeBlock();
+      canvas->save();
+      canvas->setClipRect(QRectF(block->x, block->y, block->width, block->height), Qt::IntersectClip);
+      block->paint(canvas);
+      canvas->restore();
+    }
+    if (status() == Insertion && !targetPoint().isNull())
+    {
+      QFlowChartStyle st = chartStyle();
+      QPointF p = targetPoint().point();
+      canvas->setPen(QPen(st.selectedBackground(), 2 * zoom()));
+      canvas->setBrush(st.selectedBackground());
+      canvas->drawEllipse(p, 7 * zoom(), 7 * zoom());
     }
 }
 
+const QFlowChartRenderContext & QFlowChart::renderContext(QPaintDevice *device, bool fontSizeInPoints)
+{
+    QFlowChartRenderContext &rc = fRenderContext;
+    int dpi = device ? device->logicalDpiY() : 0;
+    bool interacting = fScreenPainting && fInteracting;
+    if (fRenderContextValid && rc.zoom == zoom() && rc.dpi == dpi && rc.fontSizeInPoints == fontSizeInPoints
+        && rc.screen == fScreenPainting && rc.interacting == interacting)
+    {
+      return rc;
+    }
+    rc.zoom = zoom();
+    rc.dpi = dpi;
+    rc.fontSizeInPoints = fontSizeInPoints;
+    rc.screen = fScreenPainting;
+    rc.interacting = interacting;
+    rc.drawText = !rc.screen || zoom() >= textMinZoom;
+    rc.drawShadows = !rc.screen || (!interacting && zoom() >= shadowMinZoom);
+    rc.drawArrows = !rc.screen || zoom() >= arrowMinZoom;
+    rc.drawOutlines = rc.screen && zoom() < outlineMaxZoom;
+    rc.lineWidth = fStyle.lineWidth() * zoom();
+    rc.shadowOffset = 4 * zoom();
+
+    QFont font("Tahoma");
+    font.setWeight(0);
+    if (fontSizeInPoints)
+      font.setPointSizeF(10 * zoom());
+    else
+      font.setPixelSize(13 * zoom());
+    rc.font = device ? QFont(font, device) : font;
+
+    rc.normalPen = QPen(fStyle.normalForeground(), rc.lineWidth, Qt::SolidLine, Qt::FlatCap, Qt::MiterJoin);
+    rc.selectedPen = QPen(fStyle.selectedForeground(), rc.lineWidth, Qt::SolidLine, Qt::FlatCap, Qt::MiterJoin);
+    rc.normalBrush = QBrush(fStyle.normalBackground());
+    rc.selectedBrush = QBrush(fStyle.selectedBackground());
+    rc.shadowBrush = QBrush(QColor(0, 0, 0, 40)); // subtle semi-transparent shadow
+    rc.bottomArrow = QSize(6 * zoom(), 12 * zoom());
+    rc.rightArrow = QSize(12 * zoom(), 6 * zoom());
+
+    rc.beginText = QBlock::tr("BEGIN");
+    rc.endText = QBlock::tr("END");
+    rc.yesText = QBlock::tr("Yes");
+    rc.noText = QBlock::tr("No");
+    fRenderContextValid = true;
+    invalidateMemoryUsage();
+    return rc;
+}
+
+void QFlowChart::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::LanguageChange)
+    {
+      fRenderContextValid = false;
+      invalidateContent();
+      update();
+    }
+    QWidget::changeEvent(event);
+}
+
+QRect QFlowChart::markerRect(const QInsertionPoint &aPoint) const
+{
+    if (aPoint.isNull()) return QRect();
+    double r = 9 * zoom();
+    return QRectF(aPoint.point().x() - r, aPoint.point().y() - r, 2 * r, 2 * r).toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+QRect QFlowChart::blockRect(const QBlock *aBlock)
+{
+    return QRectF(aBlock->x, aBlock->y, aBlock->width, aBlock->height).toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
 
 /******************************** QBlock ***********************************/
 
@@ -70,47 +382,69 @@ void QBlock::drawCaption(QPainter *canvas, const QRectF & rect, const double zoo
 
 }
 
+void QBlock::drawCaptionText(QPainter *canvas, const QRectF &rect, bool wrap) const
+{
+  updateCaptionText();
+  double textWidth = wrap ? rect.width() : -1;
+  if (!fCaption.prepared || fCaption.paintWidth != textWidth || fCaption.paintFont != canvas->font())
+  {
+    QTextOption option(Qt::AlignHCenter);
+    option.setWrapMode(wrap ? QTextOption::WrapAnywhere : QTextOption::NoWrap);
+    fCaption.staticText.setTextFormat(Qt::PlainText);
+    fCaption.staticText.setTextOption(option);
+    fCaption.staticText.setTextWidth(textWidth);
+    fCaption.staticText.setText(fCaption.text);
+    fCaption.staticText.prepare(QTransform(), canvas->font());
+    fCaption.paintFont = canvas->font();
+    fCaption.paintWidth = textWidth;
+    fCaption.prepared = true;
+  }
+  /* centered in the rectangle; lines are centered by the text option */
+  QSizeF size = fCaption.staticText.size();
+  QPointF pos(wrap ? rect.left() : rect.center().x() - size.width() / 2, rect.center().y() - size.height() / 2);
+  if (size.width() > rect.width() || size.height() > rect.height())
+  {
+    canvas->save();
+    canvas->setClipRect(rect, Qt::IntersectClip);
+    canvas->drawStaticText(pos, fCaption.staticText);
+    canvas->restore();
+  }
+  else
+  {
+    canvas->drawStaticText(pos, fCaption.staticText);
+  }
+}
+
 void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
 {
   if (flowChart())
   {
-    QFlowChartStyle st = flowChart()->chartStyle();
+    paint(canvas, flowChart()->renderContext(canvas->device(), fontSizeInPoints));
+  }
+}
+
+void QBlock::paint(QPainter *canvas, const QFlowChartRenderContext &rc) const
+{
+  if (flowChart())
+  {
+    flowChart()->countPaintedBlock();
+    /* the cached content layer is painted without selection, the selected
+       subtree is painted again over it by QFlowChart::paintOverlay() */
+    bool selected = flowChart()->status() == QFlowChart::Selectable && !flowChart()->isPaintingContent() && isActive();
+    const QPen &pen = selected ? rc.selectedPen : rc.normalPen;
+    const QBrush &brush = selected ? rc.selectedBrush : rc.normalBrush;
+    double z = rc.zoom;
     double hcenter = x + width / 2;
     /* в соответствии с ГОСТ 19.003-80 */
-    double a = 60 * zoom();
+    double a = 60 * z;
     double b = 2 * a;
     double bottom = y + height;
-    double lw = st.lineWidth() * zoom();
-
-//    QFont font = flowChart()->font();
-//    font.setPixelSize(13 * zoom());
-//    flowChart()->setFont(font);
-
-    QFont font("Tahoma");
-    font.setWeight(0);
-    if (fontSizeInPoints)
-      font.setPointSizeF(10 * zoom());
-    else
-      font.setPixelSize(13 * zoom());
-    font = QFont(font, canvas->device());
-    canvas->setFont(font);
-
-    if(flowChart()->status() == QFlowChart::Selectable && isActive())
-    {
-      canvas->setPen(QPen(st.selectedForeground(), lw));
-      canvas->setBrush(QBrush(st.selectedBackground()));
-    }
-    else
-    {
-      canvas->setPen(QPen(st.normalForeground(), lw));
-      canvas->setBrush(QBrush(st.normalBackground()));
-    }
+    double lw = rc.lineWidth;
 
-    QPen pen = canvas->pen();
-    pen.setCapStyle(Qt::FlatCap);
-    pen.setJoinStyle(Qt::MiterJoin);
+    canvas->setFont(rc.font);
     canvas->setPen(pen);
-    canvas->fillRect(QRectF(x, y, width, height), canvas->brush());
+    canvas->setBrush(brush);
+    canvas->fillRect(QRectF(x, y, width, height), brush);
 
     if (isBranch)
     {
@@ -118,12 +452,32 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
       QLineF line(hcenter, y-0.5, hcenter, y + height+0.5);
       canvas->drawLine(line);
     }
+    else if (rc.drawOutlines)
+    {
+      /* simple blocks become a rectangle on the flow line, compound blocks
+         a frame around their branches */
+      if (type() == "algorithm")
+      {
+        canvas->drawLine(QLineF(hcenter, lw, hcenter, bottom - lw));
+        canvas->drawRect(QRectF(hcenter - b/2, lw, b, a/2));
+        canvas->drawRect(QRectF(hcenter - b/2, bottom - a/2 - lw, b, a/2));
+      }
+      else if (items.isEmpty())
+      {
+        double blockWidth = width - leftMargin - rightMargin;
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, bottom+0.5));
+        canvas->drawRect(QRectF(hcenter - blockWidth/2, y + 16 * z, blockWidth, a));
+      }
+      else
+      {
+        canvas->setBrush(Qt::NoBrush);
+        canvas->drawRect(QRectF(x, y, width, height));
+      }
+    }
     else
     {
-      // Modern shadow offset for box-shadow effect
-      double shadowOffset = 4 * zoom();
-      QColor shadowColor(0, 0, 0, 40); // Subtle semi-transparent shadow
-      
+      double shadowOffset = rc.shadowOffset;
+
       if (type() == "algorithm")
       {
         /* алгоритм */
@@ -132,326 +486,306 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
         
         // Draw shadow for BEGIN block
         QRectF shadowOval(hcenter - b/2 + shadowOffset, lw + shadowOffset, b, a/2);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawRoundedRect(shadowOval, a/4, a/4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawRoundedRect(shadowOval, a/4, a/4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QRectF oval(hcenter - b/2, lw, b, a/2);
         canvas->drawRoundedRect(oval, a/4, a/4);
-        canvas->drawText(oval, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, tr("BEGIN"));
+        if (rc.drawText) canvas->drawText(oval, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, rc.beginText);
 //        drawCaption(canvas, oval, zoom(), tr("BEGIN"));
         canvas->drawLine(QLineF(hcenter, y + a/2+lw, hcenter, body->y+0.5));
         canvas->drawLine(QLineF(hcenter, body->y + body->height-0.5, hcenter, bottom - a/2-lw));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, bottom - a/2 - lw),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, bottom - a/2 - lw),
+                                      rc.bottomArrow);
 
         // Draw shadow for END block
         QRectF shadowOvalEnd(hcenter - b/2 + shadowOffset, bottom - a/2 - lw + shadowOffset, b, a/2);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawRoundedRect(shadowOvalEnd, a/4, a/4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawRoundedRect(shadowOvalEnd, a/4, a/4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         oval = QRectF(hcenter - b/2, bottom - a/2 - lw, b, a/2);
         canvas->drawRoundedRect(oval, a/4, a/4);
-        canvas->drawText(oval, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, tr("END"));
+        if (rc.drawText) canvas->drawText(oval, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, rc.endText);
 
       }
       else if(type() == "process")
       {
         /* процесс */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * z),
+                                      rc.bottomArrow);
         // Используем динамическую ширину блока
         double blockWidth = width - leftMargin - rightMargin;
         
         // Draw shadow
-        QRectF shadowRect(hcenter - blockWidth/2 + shadowOffset, y + 16 * zoom() + shadowOffset, blockWidth, a);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawRect(shadowRect);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        QRectF shadowRect(hcenter - blockWidth/2 + shadowOffset, y + 16 * z + shadowOffset, blockWidth, a);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawRect(shadowRect);
         }
         
-        QRectF rect(hcenter - blockWidth/2, y + 16 * zoom(), blockWidth, a);
-        QRectF textRect(hcenter - blockWidth/2 + 4 * zoom(), y + 20 * zoom(), blockWidth - 8 * zoom(), a - 8 * zoom());
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
+        QRectF rect(hcenter - blockWidth/2, y + 16 * z, blockWidth, a);
+        QRectF textRect(hcenter - blockWidth/2 + 4 * z, y + 20 * z, blockWidth - 8 * z, a - 8 * z);
         canvas->drawRect(rect);
-        canvas->drawText(textRect, Qt::AlignCenter | Qt::TextWrapAnywhere, attributes.value("text", ""));
-        canvas->drawLine(QLineF(hcenter, y + 16 * zoom()+a, hcenter, bottom+0.5));
+        if (rc.drawText) drawCaptionText(canvas, textRect, true);
+        canvas->drawLine(QLineF(hcenter, y + 16 * z+a, hcenter, bottom+0.5));
       }
       else if(type() == "assign")
       {
         /* присваивание */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * z),
+                                      rc.bottomArrow);
         // Используем динамическую ширину блока
         double blockWidth = width - leftMargin - rightMargin;
         
         // Draw shadow
-        QRectF shadowRect(hcenter - blockWidth/2 + shadowOffset, y + 16 * zoom() + shadowOffset, blockWidth, a);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawRect(shadowRect);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        QRectF shadowRect(hcenter - blockWidth/2 + shadowOffset, y + 16 * z + shadowOffset, blockWidth, a);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawRect(shadowRect);
         }
         
-        QRectF rect(hcenter - blockWidth/2, y + 16 * zoom(), blockWidth, a);
-        QRectF textRect(hcenter - blockWidth/2+4, y + 16 * zoom()+4, blockWidth-8, a-8);
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
+        QRectF rect(hcenter - blockWidth/2, y + 16 * z, blockWidth, a);
+        QRectF textRect(hcenter - blockWidth/2+4, y + 16 * z+4, blockWidth-8, a-8);
         canvas->drawRect(rect);
-        canvas->drawText(textRect, Qt::AlignCenter | Qt::TextWrapAnywhere, QString("%1 := %2").arg(attributes.value("dest", ""), attributes.value("src", "")));
-        canvas->drawLine(QLineF(hcenter, y + 16 * zoom()+a, hcenter, bottom+0.5));
+        if (rc.drawText) drawCaptionText(canvas, textRect, true);
+        canvas->drawLine(QLineF(hcenter, y + 16 * z+a, hcenter, bottom+0.5));
       }
       else if(type() == "io")
       {
         /* ввод/вывод */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * z),
+                                      rc.bottomArrow);
         // Используем динамическую ширину блока вместо фиксированной b
         double blockWidth = width - leftMargin - rightMargin;
         
         // Draw shadow parallelogram
         QPointF shadowPar[4];
-        shadowPar[0] = QPointF(hcenter - blockWidth/2 + a/4 + shadowOffset, y + 16 * zoom() + shadowOffset);
-        shadowPar[1] = QPointF(hcenter + blockWidth/2 + a/4 + shadowOffset, y + 16 * zoom() + shadowOffset);
-        shadowPar[2] = QPointF(hcenter + blockWidth/2 - a/4 + shadowOffset, y + 16 * zoom() + a + shadowOffset);
-        shadowPar[3] = QPointF(hcenter - blockWidth/2 - a/4 + shadowOffset, y + 16 * zoom() + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowPar, 4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        shadowPar[0] = QPointF(hcenter - blockWidth/2 + a/4 + shadowOffset, y + 16 * z + shadowOffset);
+        shadowPar[1] = QPointF(hcenter + blockWidth/2 + a/4 + shadowOffset, y + 16 * z + shadowOffset);
+        shadowPar[2] = QPointF(hcenter + blockWidth/2 - a/4 + shadowOffset, y + 16 * z + a + shadowOffset);
+        shadowPar[3] = QPointF(hcenter - blockWidth/2 - a/4 + shadowOffset, y + 16 * z + a + shadowOffset);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowPar, 4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF par[4];
-        par[0] = QPointF(hcenter - blockWidth/2 + a/4, y + 16 * zoom());
-        par[1] = QPointF(hcenter + blockWidth/2 + a/4, y + 16 * zoom());
-        par[2] = QPointF(hcenter + blockWidth/2 - a/4, y + 16 * zoom() + a);
-        par[3] = QPointF(hcenter - blockWidth/2 - a/4, y + 16 * zoom() + a);
+        par[0] = QPointF(hcenter - blockWidth/2 + a/4, y + 16 * z);
+        par[1] = QPointF(hcenter + blockWidth/2 + a/4, y + 16 * z);
+        par[2] = QPointF(hcenter + blockWidth/2 - a/4, y + 16 * z + a);
+        par[3] = QPointF(hcenter - blockWidth/2 - a/4, y + 16 * z + a);
         canvas->drawPolygon(par, 4);
-        QRectF rect(hcenter - blockWidth/2, y + 16 * zoom(), blockWidth, a);
-        QStringList ls = attributes["vars"].split(",");
-
-        QString text = ls.join(", ");
-        canvas->drawText(rect, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, text);
-        canvas->drawLine(QLineF(hcenter, y + 16 * zoom()+a, hcenter, bottom+0.5));
+        QRectF rect(hcenter - blockWidth/2, y + 16 * z, blockWidth, a);
+        if (rc.drawText) drawCaptionText(canvas, rect, false);
+        canvas->drawLine(QLineF(hcenter, y + 16 * z+a, hcenter, bottom+0.5));
       }
       else if(type() == "ou")
       {
         /* ввод/вывод */
-        canvas->drawLine(QLineF(hcenter, y, hcenter, y + 16 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y, hcenter, y + 16 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * z),
+                                      rc.bottomArrow);
         // Используем динамическую ширину блока вместо фиксированной b
         double blockWidth = width - leftMargin - rightMargin;
         
         // Draw shadow parallelogram
         QPointF shadowPar[4];
-        shadowPar[0] = QPointF(hcenter - blockWidth/2 + a/4 + shadowOffset, y + 16 * zoom() + shadowOffset);
-        shadowPar[1] = QPointF(hcenter + blockWidth/2 + a/4 + shadowOffset, y + 16 * zoom() + shadowOffset);
-        shadowPar[2] = QPointF(hcenter + blockWidth/2 - a/4 + shadowOffset, y + 16 * zoom() + a + shadowOffset);
-        shadowPar[3] = QPointF(hcenter - blockWidth/2 - a/4 + shadowOffset, y + 16 * zoom() + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowPar, 4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        shadowPar[0] = QPointF(hcenter - blockWidth/2 + a/4 + shadowOffset, y + 16 * z + shadowOffset);
+        shadowPar[1] = QPointF(hcenter + blockWidth/2 + a/4 + shadowOffset, y + 16 * z + shadowOffset);
+        shadowPar[2] = QPointF(hcenter + blockWidth/2 - a/4 + shadowOffset, y + 16 * z + a + shadowOffset);
+        shadowPar[3] = QPointF(hcenter - blockWidth/2 - a/4 + shadowOffset, y + 16 * z + a + shadowOffset);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowPar, 4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF par[4];
-        par[0] = QPointF(hcenter - blockWidth/2 + a/4, y + 16 * zoom());
-        par[1] = QPointF(hcenter + blockWidth/2 + a/4, y + 16 * zoom());
-        par[2] = QPointF(hcenter + blockWidth/2 - a/4, y + 16 * zoom() + a);
-        par[3] = QPointF(hcenter - blockWidth/2 - a/4, y + 16 * zoom() + a);
+        par[0] = QPointF(hcenter - blockWidth/2 + a/4, y + 16 * z);
+        par[1] = QPointF(hcenter + blockWidth/2 + a/4, y + 16 * z);
+        par[2] = QPointF(hcenter + blockWidth/2 - a/4, y + 16 * z + a);
+        par[3] = QPointF(hcenter - blockWidth/2 - a/4, y + 16 * z + a);
         canvas->drawPolygon(par, 4);
-        QRectF textRect(hcenter - blockWidth/2 + a/4 +4, y + 16 * zoom()+4, blockWidth-a/2 - 8, a - 8);
-        QStringList ls = attributes["vars"].split(",");
-        QString text = ls.join(", ");
-        canvas->drawText(textRect, Qt::TextSingleLine | Qt::AlignHCenter | Qt::AlignVCenter, text);
-        canvas->drawLine(QLineF(hcenter, y + 16 * zoom()+a, hcenter, bottom+0.5));
+        QRectF textRect(hcenter - blockWidth/2 + a/4 +4, y + 16 * z+4, blockWidth-a/2 - 8, a - 8);
+        if (rc.drawText) drawCaptionText(canvas, textRect, false);
+        canvas->drawLine(QLineF(hcenter, y + 16 * z+a, hcenter, bottom+0.5));
       }
       else if(type() == "if")
       {
         /* ветвление */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 16 * z),
+                                      rc.bottomArrow);
         
         // Draw shadow diamond
         QPointF shadowPar[4];
-        shadowPar[0] = QPointF(hcenter - b/2 + shadowOffset, y + 16 * zoom() + a/2 + shadowOffset);
-        shadowPar[1] = QPointF(hcenter + shadowOffset     , y + 16 * zoom() + shadowOffset);
-        shadowPar[2] = QPointF(hcenter + b/2 + shadowOffset, y + 16 * zoom() + a/2 + shadowOffset);
-        shadowPar[3] = QPointF(hcenter + shadowOffset     , y + 16 * zoom() + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowPar, 4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        shadowPar[0] = QPointF(hcenter - b/2 + shadowOffset, y + 16 * z + a/2 + shadowOffset);
+        shadowPar[1] = QPointF(hcenter + shadowOffset     , y + 16 * z + shadowOffset);
+        shadowPar[2] = QPointF(hcenter + b/2 + shadowOffset, y + 16 * z + a/2 + shadowOffset);
+        shadowPar[3] = QPointF(hcenter + shadowOffset     , y + 16 * z + a + shadowOffset);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowPar, 4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF par[4];
-        par[0] = QPointF(hcenter - b/2, y + 16 * zoom() + a/2);
-        par[1] = QPointF(hcenter      , y + 16 * zoom()      );
-        par[2] = QPointF(hcenter + b/2, y + 16 * zoom() + a/2);
-        par[3] = QPointF(hcenter      , y + 16 * zoom() + a  );
+        par[0] = QPointF(hcenter - b/2, y + 16 * z + a/2);
+        par[1] = QPointF(hcenter      , y + 16 * z      );
+        par[2] = QPointF(hcenter + b/2, y + 16 * z + a/2);
+        par[3] = QPointF(hcenter      , y + 16 * z + a  );
         canvas->drawPolygon(par, 4);
-        QRectF textRect(hcenter - b/2 + a/4 + 20, y + 16 * zoom()+4 + a/8, b - a/2 - 40, a - 8 - a/4);
-        canvas->drawText(textRect, Qt::AlignCenter | Qt::TextWrapAnywhere, QString("%1?").arg(attributes.value("cond", "")));
+        QRectF textRect(hcenter - b/2 + a/4 + 20, y + 16 * z+4 + a/8, b - a/2 - 40, a - 8 - a/4);
+        if (rc.drawText) drawCaptionText(canvas, textRect, true);
         QBlock *left = item(0);
         Q_ASSERT_X(left != 0, "QBlock::paint()" ,"item(0) == 0. i.e. left branch of IF is nul.");
         QBlock *right = item(1);
         Q_ASSERT_X(right != 0, "QBlock::paint()" ,"item(1) == 0. i.e. right branch of IF is nul.");
         // левая линия
         QPointF line[3];
-        line[0] = QPointF(hcenter - b/2, y + 16 * zoom() + a/2);
-        line[1] = QPointF(left->x+left->width/2, y + 16 * zoom() + a/2);
+        line[0] = QPointF(hcenter - b/2, y + 16 * z + a/2);
+        line[1] = QPointF(left->x+left->width/2, y + 16 * z + a/2);
         line[2] = QPointF(left->x+left->width/2, left->y);
         canvas->drawPolyline(line, 3);
 
-        canvas->drawText(QPointF(hcenter - b/2 - 24*zoom(), y + 12 * zoom() + a/2), tr("Yes"));
+        if (rc.drawText) canvas->drawText(QPointF(hcenter - b/2 - 24*z, y + 12 * z + a/2), rc.yesText);
 
         // правая линия
-        line[0] = QPointF(hcenter + b/2, y + 16 * zoom() + a/2);
-        line[1] = QPointF(right->x+right->width/2, y + 16 * zoom() + a/2);
+        line[0] = QPointF(hcenter + b/2, y + 16 * z + a/2);
+        line[1] = QPointF(right->x+right->width/2, y + 16 * z + a/2);
         line[2] = QPointF(right->x+right->width/2, right->y);
         canvas->drawPolyline(line, 3);
-        canvas->drawText(QPointF(hcenter + b/2 +5*zoom(), y + 12 * zoom() + a/2), tr("No"));
+        if (rc.drawText) canvas->drawText(QPointF(hcenter + b/2 +5*z, y + 12 * z + a/2), rc.noText);
 
         // соединение
         QPointF collector[4];
         collector[0] = QPointF(left->x + left->width / 2, left->y+left->height);
-        collector[1] = QPointF(left->x + left->width / 2, bottom - 8*zoom());
-        collector[2] = QPointF(right->x + right->width / 2, bottom - 8*zoom());
+        collector[1] = QPointF(left->x + left->width / 2, bottom - 8*z);
+        collector[2] = QPointF(right->x + right->width / 2, bottom - 8*z);
         collector[3] = QPointF(right->x + right->width / 2, right->y+right->height);
         canvas->drawPolyline(collector, 4);
-        canvas->drawLine(QLineF(hcenter, bottom-8*zoom(), hcenter, bottom+0.5));
+        canvas->drawLine(QLineF(hcenter, bottom-8*z, hcenter, bottom+0.5));
       }
       else if(type() == "pre")
       {
         /* цикл с предусловием */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 32 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 32 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 32 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 32 * z),
+                                      rc.bottomArrow);
         
         // Draw shadow diamond
         QPointF shadowPar[4];
-        shadowPar[0] = QPointF(hcenter - b/2 + shadowOffset, y + 32 * zoom() + a/2 + shadowOffset);
-        shadowPar[1] = QPointF(hcenter + shadowOffset     , y + 32 * zoom() + shadowOffset);
-        shadowPar[2] = QPointF(hcenter + b/2 + shadowOffset, y + 32 * zoom() + a/2 + shadowOffset);
-        shadowPar[3] = QPointF(hcenter + shadowOffset     , y + 32 * zoom() + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowPar, 4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        shadowPar[0] = QPointF(hcenter - b/2 + shadowOffset, y + 32 * z + a/2 + shadowOffset);
+        shadowPar[1] = QPointF(hcenter + shadowOffset     , y + 32 * z + shadowOffset);
+        shadowPar[2] = QPointF(hcenter + b/2 + shadowOffset, y + 32 * z + a/2 + shadowOffset);
+        shadowPar[3] = QPointF(hcenter + shadowOffset     , y + 32 * z + a + shadowOffset);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowPar, 4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF par[4];
-        par[0] = QPointF(hcenter - b/2, y + 32 * zoom() + a/2);
-        par[1] = QPointF(hcenter      , y + 32 * zoom()      );
-        par[2] = QPointF(hcenter + b/2, y + 32 * zoom() + a/2);
-        par[3] = QPointF(hcenter      , y + 32 * zoom() + a  );
+        par[0] = QPointF(hcenter - b/2, y + 32 * z + a/2);
+        par[1] = QPointF(hcenter      , y + 32 * z      );
+        par[2] = QPointF(hcenter + b/2, y + 32 * z + a/2);
+        par[3] = QPointF(hcenter      , y + 32 * z + a  );
         canvas->drawPolygon(par, 4);
-        QRectF rect(hcenter - b/2, y + 32 * zoom(), b, a);
-        canvas->drawText(rect, Qt::AlignCenter | Qt::TextWrapAnywhere, QString("%1?").arg(attributes.value("cond", "")));
+        QRectF rect(hcenter - b/2, y + 32 * z, b, a);
+        if (rc.drawText) drawCaptionText(canvas, rect, true);
         QBlock *left = item(0);
         Q_ASSERT_X(left != 0, "QBlock::paint()" ,"item(0) == 0. i.e. body of PRE-loop is nul.");
-        canvas->drawLine(QLineF(hcenter,y + 32 * zoom() + a,hcenter,left->y));
+        canvas->drawLine(QLineF(hcenter,y + 32 * z + a,hcenter,left->y));
 
 //        // правая линия
         QPointF line[5];
-        line[0] = QPointF(hcenter + b/2, y + 32 * zoom() + a/2);
-        line[1] = QPointF(x + width - 5*zoom(), y + 32 * zoom() + a/2);
-        line[2] = QPointF(x + width - 5*zoom(), bottom - 4 * zoom());
-        line[3] = QPointF(hcenter, bottom - 4 * zoom());
+        line[0] = QPointF(hcenter + b/2, y + 32 * z + a/2);
+        line[1] = QPointF(x + width - 5*z, y + 32 * z + a/2);
+        line[2] = QPointF(x + width - 5*z, bottom - 4 * z);
+        line[3] = QPointF(hcenter, bottom - 4 * z);
         line[4] = QPointF(hcenter, bottom+0.5);
         canvas->drawPolyline(line, 5);
-        canvas->drawText(QPointF(hcenter + 4*zoom(), y + 44 * zoom() + a), tr("Yes"));
-        canvas->drawText(QPointF(hcenter + b/2 +5*zoom(), y + 28 * zoom() + a/2), tr("No"));
+        if (rc.drawText) canvas->drawText(QPointF(hcenter + 4*z, y + 44 * z + a), rc.yesText);
+        if (rc.drawText) canvas->drawText(QPointF(hcenter + b/2 +5*z, y + 28 * z + a/2), rc.noText);
 
         // соединение
         QPointF collector[5];
         collector[0] = QPointF(hcenter, left->y+left->height);
-        collector[1] = QPointF(hcenter, bottom - 28*zoom());
-        collector[2] = QPointF(x + 5*zoom(), bottom - 28*zoom());
-        collector[3] = QPointF(x + 5*zoom(), y + 8*zoom());
-        collector[4] = QPointF(hcenter, y + 8*zoom());
+        collector[1] = QPointF(hcenter, bottom - 28*z);
+        collector[2] = QPointF(x + 5*z, bottom - 28*z);
+        collector[3] = QPointF(x + 5*z, y + 8*z);
+        collector[4] = QPointF(hcenter, y + 8*z);
         canvas->drawPolyline(collector, 5);
-        QFlowChart::drawRightArrow(canvas, collector[4],
-                                    QSize(12 * zoom(), 6 * zoom()));
+        if (rc.drawArrows)
+          QFlowChart::drawRightArrow(canvas, collector[4],
+                                      rc.rightArrow);
 
       }
       else if(type() == "post")
       {
         /* цикл с постусловием */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 16 * z));
         QBlock *left = item(0);
         Q_ASSERT_X(left != 0, "QBlock::paint()" ,"item(0) == 0. i.e. body of POST-loop is nul.");
         // верх ромба с входяящей стрелкой
-        double top = left->y+left->height + 16 * zoom();
+        double top = left->y+left->height + 16 * z;
 
         canvas->drawLine(QLineF(hcenter,left->y+left->height,hcenter,top));
 
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, top),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, top),
+                                      rc.bottomArrow);
         
         // Draw shadow diamond
         QPointF shadowPar[4];
@@ -459,19 +793,16 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
         shadowPar[1] = QPointF(hcenter + shadowOffset     , top + shadowOffset);
         shadowPar[2] = QPointF(hcenter + b/2 + shadowOffset, top + a/2 + shadowOffset);
         shadowPar[3] = QPointF(hcenter + shadowOffset     , top + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowPar, 4);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowPar, 4);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF par[4];
         par[0] = QPointF(hcenter - b/2, top + a/2);
         par[1] = QPointF(hcenter      , top      );
@@ -479,20 +810,21 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
         par[3] = QPointF(hcenter      , top + a  );
         canvas->drawPolygon(par, 4);
         QRectF rect(hcenter - b/2, top, b, a);
-        canvas->drawText(rect, Qt::AlignCenter | Qt::TextWrapAnywhere, QString("%1?").arg(attributes.value("cond", "")));
+        if (rc.drawText) drawCaptionText(canvas, rect, true);
 
-        canvas->drawText(QPointF(hcenter - b/2 - 24*zoom(), top - 4* zoom() + a/2), tr("Yes"));
-        canvas->drawText(QPointF(hcenter  +4*zoom(), top + 16 * zoom() + a), tr("No"));
+        if (rc.drawText) canvas->drawText(QPointF(hcenter - b/2 - 24*z, top - 4* z + a/2), rc.yesText);
+        if (rc.drawText) canvas->drawText(QPointF(hcenter  +4*z, top + 16 * z + a), rc.noText);
 
         // соединение
         QPointF collector[4];
         collector[0] = QPointF(hcenter - b/2, top + a/2);
-        collector[1] = QPointF(x + 5*zoom(), top + a/2);
-        collector[2] = QPointF(x + 5*zoom(), y + 8*zoom());
-        collector[3] = QPointF(hcenter, y + 8*zoom());
+        collector[1] = QPointF(x + 5*z, top + a/2);
+        collector[2] = QPointF(x + 5*z, y + 8*z);
+        collector[3] = QPointF(hcenter, y + 8*z);
         canvas->drawPolyline(collector, 4);
-        QFlowChart::drawRightArrow(canvas, collector[3],
-                                    QSize(12 * zoom(), 6 * zoom()));
+        if (rc.drawArrows)
+          QFlowChart::drawRightArrow(canvas, collector[3],
+                                      rc.rightArrow);
 
         // выход
         canvas->drawLine(QLineF(hcenter, top + a, hcenter, bottom+0.5));
@@ -500,65 +832,64 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
       else if(type() == "for")
       {
         /* цикл FOR */
-        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 32 * zoom()));
-        QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 32 * zoom()),
-                                    QSize(6 * zoom(), 12 * zoom()));
+        canvas->drawLine(QLineF(hcenter, y-0.5, hcenter, y + 32 * z));
+        if (rc.drawArrows)
+          QFlowChart::drawBottomArrow(canvas, QPointF(hcenter, y + 32 * z),
+                                      rc.bottomArrow);
         
         // Draw shadow hexagon
         QPointF shadowHex[6];
-        shadowHex[0] = QPointF(hcenter - b/2 + shadowOffset, y + 32 * zoom() + a/2 + shadowOffset);
-        shadowHex[1] = QPointF(hcenter - a/2 + shadowOffset, y + 32 * zoom() + shadowOffset);
-        shadowHex[2] = QPointF(hcenter + a/2 + shadowOffset, y + 32 * zoom() + shadowOffset);
-        shadowHex[3] = QPointF(hcenter + b/2 + shadowOffset, y + 32 * zoom() + a/2 + shadowOffset);
-        shadowHex[4] = QPointF(hcenter + a/2 + shadowOffset, y + 32 * zoom() + a + shadowOffset);
-        shadowHex[5] = QPointF(hcenter - a/2 + shadowOffset, y + 32 * zoom() + a + shadowOffset);
-        canvas->setPen(Qt::NoPen);
-        canvas->setBrush(shadowColor);
-        canvas->drawPolygon(shadowHex, 6);
-        
-        // Restore pen/brush
-        if(flowChart()->status() == QFlowChart::Selectable && isActive()) {
-          canvas->setPen(QPen(st.selectedForeground(), lw));
-          canvas->setBrush(QBrush(st.selectedBackground()));
-        } else {
-          canvas->setPen(QPen(st.normalForeground(), lw));
-          canvas->setBrush(QBrush(st.normalBackground()));
+        shadowHex[0] = QPointF(hcenter - b/2 + shadowOffset, y + 32 * z + a/2 + shadowOffset);
+        shadowHex[1] = QPointF(hcenter - a/2 + shadowOffset, y + 32 * z + shadowOffset);
+        shadowHex[2] = QPointF(hcenter + a/2 + shadowOffset, y + 32 * z + shadowOffset);
+        shadowHex[3] = QPointF(hcenter + b/2 + shadowOffset, y + 32 * z + a/2 + shadowOffset);
+        shadowHex[4] = QPointF(hcenter + a/2 + shadowOffset, y + 32 * z + a + shadowOffset);
+        shadowHex[5] = QPointF(hcenter - a/2 + shadowOffset, y + 32 * z + a + shadowOffset);
+        if (rc.drawShadows)
+        {
+          canvas->setPen(Qt::NoPen);
+          canvas->setBrush(rc.shadowBrush);
+          canvas->drawPolygon(shadowHex, 6);
         }
         
+        canvas->setPen(pen);
+        canvas->setBrush(brush);
+        
         QPointF hex[6];
-        hex[0] = QPointF(hcenter - b/2, y + 32 * zoom() + a/2);
-        hex[1] = QPointF(hcenter - a/2, y + 32 * zoom()      );
-        hex[2] = QPointF(hcenter + a/2, y + 32 * zoom()      );
-        hex[3] = QPointF(hcenter + b/2, y + 32 * zoom() + a/2);
-        hex[4] = QPointF(hcenter + a/2, y + 32 * zoom() + a  );
-        hex[5] = QPointF(hcenter - a/2, y + 32 * zoom() + a  );
+        hex[0] = QPointF(hcenter - b/2, y + 32 * z + a/2);
+        hex[1] = QPointF(hcenter - a/2, y + 32 * z      );
+        hex[2] = QPointF(hcenter + a/2, y + 32 * z      );
+        hex[3] = QPointF(hcenter + b/2, y + 32 * z + a/2);
+        hex[4] = QPointF(hcenter + a/2, y + 32 * z + a  );
+        hex[5] = QPointF(hcenter - a/2, y + 32 * z + a  );
         canvas->drawPolygon(hex, 6);
 
-        QRectF rect(hcenter - b/2, y + 32 * zoom(), b, a);
-        canvas->drawText(rect, Qt::AlignCenter | Qt::TextWrapAnywhere, QString("%1 := %2...%3").arg(attributes.value("var", ""), attributes.value("from", ""), attributes.value("to", "")));
+        QRectF rect(hcenter - b/2, y + 32 * z, b, a);
+        if (rc.drawText) drawCaptionText(canvas, rect, true);
         QBlock *left = item(0);
         Q_ASSERT_X(left != 0, "QBlock::paint()" ,"item(0) == 0. i.e. body of PRE-loop is nul.");
-        canvas->drawLine(QLineF(hcenter,y + 32 * zoom() + a,hcenter,left->y));
+        canvas->drawLine(QLineF(hcenter,y + 32 * z + a,hcenter,left->y));
 
 //        // правая линия
         QPointF line[5];
-        line[0] = QPointF(hcenter + b/2, y + 32 * zoom() + a/2);
-        line[1] = QPointF(x + width - 5*zoom(), y + 32 * zoom() + a/2);
-        line[2] = QPointF(x + width - 5*zoom(), bottom - 4 * zoom());
-        line[3] = QPointF(hcenter, bottom - 4 * zoom());
+        line[0] = QPointF(hcenter + b/2, y + 32 * z + a/2);
+        line[1] = QPointF(x + width - 5*z, y + 32 * z + a/2);
+        line[2] = QPointF(x + width - 5*z, bottom - 4 * z);
+        line[3] = QPointF(hcenter, bottom - 4 * z);
         line[4] = QPointF(hcenter, bottom+0.5);
         canvas->drawPolyline(line, 5);
 
         // соединение
         QPointF collector[5];
         collector[0] = QPointF(hcenter, left->y+left->height);
-        collector[1] = QPointF(hcenter, bottom - 28*zoom());
-        collector[2] = QPointF(x + 5*zoom(), bottom - 28*zoom());
-        collector[3] = QPointF(x + 5*zoom(), y + 32*zoom() + a/2);
-        collector[4] = QPointF(hcenter - b/2, y + 32*zoom() + a/2);
+        collector[1] = QPointF(hcenter, bottom - 28*z);
+        collector[2] = QPointF(x + 5*z, bottom - 28*z);
+        collector[3] = QPointF(x + 5*z, y + 32*z + a/2);
+        collector[4] = QPointF(hcenter - b/2, y + 32*z + a/2);
         canvas->drawPolyline(collector, 5);
-        QFlowChart::drawRightArrow(canvas, collector[4],
-                                    QSize(12 * zoom(), 6 * zoom()));
+        if (rc.drawArrows)
+          QFlowChart::drawRightArrow(canvas, collector[4],
+                                      rc.rightArrow);
 
       }
 
@@ -566,7 +897,7 @@ void QBlock::paint(QPainter *canvas, bool fontSizeInPoints) const
     //canvas->drawText(x+8, y+12, type());
     for(int i = 0; i < items.size(); ++i)
     {
-      item(i)->paint(canvas, fontSizeInPoints);
+      item(i)->paint(canvas, rc);
     }
   }
 }